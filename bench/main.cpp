@@ -0,0 +1,548 @@
+#include "pch.hpp"
+#include "tasky.hpp"
+
+#include <barrier>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+
+using namespace tasky;
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	enum class Format
+	{
+		jsonl,
+		csv
+	};
+
+	struct Options
+	{
+		std::vector<std::size_t> threads = {};
+		std::size_t repetitions = 10;
+		std::string filter = "";
+		Format format = Format::jsonl;
+		std::filesystem::path directory = std::filesystem::temp_directory_path();
+		std::size_t file_size = 64 * 1024 * 1024;
+		Placement placement = Placement::any;
+		bool sizes = false;
+	};
+
+	/// One benchmark at one thread count and parameter, `samples` holds the seconds
+	/// every repetition took to get through `items` units of work.
+	struct Result
+	{
+		std::string name;
+		std::size_t threads;
+		std::size_t param;
+		std::size_t items;
+		const char* unit;
+		std::vector<double> samples;
+	};
+
+	/// Nearest rank percentile of sorted samples.
+	double percentile(const std::vector<double>& sorted, double p)
+	{
+		const std::size_t rank = static_cast<std::size_t>(std::ceil(p / 100.0 * static_cast<double>(sorted.size())));
+		return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+	}
+
+	void print_header(std::ostream& out, Format format)
+	{
+		if (format == Format::csv)
+			out << "name,threads,param,items,unit,repetitions,min_ns,p50_ns,p90_ns,p99_ns,max_ns,mean_ns,items_per_second" << std::endl;
+	}
+
+	void print(std::ostream& out, Format format, Result result)
+	{
+		std::sort(result.samples.begin(), result.samples.end());
+
+		const auto ns = [](double seconds) { return static_cast<std::uint64_t>(seconds * 1e9); };
+		const double mean = std::accumulate(result.samples.begin(), result.samples.end(), 0.0) / static_cast<double>(result.samples.size());
+		const double p50 = percentile(result.samples, 50);
+		const double rate = p50 > 0 ? static_cast<double>(result.items) / p50 : 0;
+
+		if (format == Format::csv)
+		{
+			out << result.name << ',' << result.threads << ',' << result.param << ',' << result.items << ',' << result.unit << ','
+				<< result.samples.size() << ',' << ns(result.samples.front()) << ',' << ns(p50) << ',' << ns(percentile(result.samples, 90)) << ','
+				<< ns(percentile(result.samples, 99)) << ',' << ns(result.samples.back()) << ',' << ns(mean) << ',' << std::fixed << std::setprecision(0) << rate << std::endl;
+		}
+		else
+		{
+			out << "{\"name\":\"" << result.name << "\",\"threads\":" << result.threads << ",\"param\":" << result.param
+				<< ",\"items\":" << result.items << ",\"unit\":\"" << result.unit << "\",\"repetitions\":" << result.samples.size()
+				<< ",\"min_ns\":" << ns(result.samples.front()) << ",\"p50_ns\":" << ns(p50) << ",\"p90_ns\":" << ns(percentile(result.samples, 90))
+				<< ",\"p99_ns\":" << ns(percentile(result.samples, 99)) << ",\"max_ns\":" << ns(result.samples.back()) << ",\"mean_ns\":" << ns(mean)
+				<< ",\"items_per_second\":" << std::fixed << std::setprecision(0) << rate << "}" << std::endl;
+		}
+	}
+
+	/// Runs `body` once to warm up and then once per repetition, `body` returns the
+	/// seconds a repetition took.
+	template<typename Body>
+	Result measure(const Options& options, std::string name, std::size_t threads, std::size_t param, std::size_t items, const char* unit, Body&& body)
+	{
+		Result result = { std::move(name), threads, param, items, unit, {} };
+		(void)body();
+
+		for (std::size_t i = 0; i < options.repetitions; i++)
+			result.samples.push_back(body());
+
+		return result;
+	}
+
+	/// Times the task from its first to its last instruction, so starting and joining
+	/// the workers in run() does not count.
+	template<typename Body>
+	Task<void> timed(Body body, double& seconds)
+	{
+		const auto begin = Clock::now();
+		co_await body();
+		seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+	}
+
+	template<typename Body>
+	double run_timed(Scheduler& scheduler, Body body)
+	{
+		double seconds = 0;
+		auto task = timed(std::move(body), seconds);
+		scheduler.schedule(task);
+		scheduler.run();
+		return seconds;
+	}
+
+	// the work of a single await or spawn is too small to time, every repetition does
+	// at least this many
+	constexpr std::size_t min_items = 100000;
+
+	template<typename Allocator>
+	Task<void, Allocator> empty()
+	{
+		co_return;
+	}
+
+	template<typename Allocator>
+	Task<std::uint64_t, Allocator> chain(std::size_t depth)
+	{
+		if (depth == 0)
+			co_return 0;
+
+		co_return co_await chain<Allocator>(depth - 1) + 1;
+	}
+
+	template<typename Allocator>
+	Task<void> chains(std::size_t depth, std::size_t count)
+	{
+		std::uint64_t total = 0;
+
+		for (std::size_t i = 0; i < count; i++)
+			total += co_await chain<Allocator>(depth);
+
+		if (total != depth * count)
+			throw std::runtime_error("chain returned the wrong depth");
+	}
+
+	template<typename Allocator>
+	Task<void> fan_out(std::size_t width, std::size_t count)
+	{
+		for (std::size_t i = 0; i < count; i++)
+		{
+			std::vector<Task<void, Allocator>> children;
+			children.reserve(width);
+
+			for (std::size_t j = 0; j < width; j++)
+				children.emplace_back(empty<Allocator>());
+
+			co_await all(std::move(children));
+		}
+	}
+
+	/// Root tasks scheduled from outside the pool, so this includes starting the workers.
+	template<typename Allocator>
+	double spawn(Scheduler& scheduler, std::size_t count)
+	{
+		std::vector<Task<void, Allocator>> tasks;
+		tasks.reserve(count);
+
+		for (std::size_t i = 0; i < count; i++)
+			tasks.emplace_back(empty<Allocator>());
+
+		const auto begin = Clock::now();
+		scheduler.schedule(tasks);
+		scheduler.run();
+		return std::chrono::duration<double>(Clock::now() - begin).count();
+	}
+
+	/// Every task schedules the next one before it returns, so the chain is handed on
+	/// from task to task through the worker's next slot.
+	template<typename Allocator>
+	Task<void, Allocator> hop(Scheduler& scheduler, std::size_t remaining)
+	{
+		if (remaining > 0)
+			scheduler.schedule(hop<Allocator>(scheduler, remaining - 1));
+
+		co_return;
+	}
+
+	/// A chain of `count` tasks, timed including run() like spawn().
+	template<typename Allocator>
+	double self_spawn(Scheduler& scheduler, std::size_t count)
+	{
+		auto first = hop<Allocator>(scheduler, count - 1);
+
+		const auto begin = Clock::now();
+		scheduler.schedule(first);
+		scheduler.run();
+		return std::chrono::duration<double>(Clock::now() - begin).count();
+	}
+
+	Task<void> volley(AsyncSemaphore& mine, AsyncSemaphore& theirs, std::size_t count)
+	{
+		for (std::size_t i = 0; i < count; i++)
+		{
+			co_await mine.acquire();
+			theirs.release();
+		}
+	}
+
+	/// Two tasks take turns `count` times each, every turn wakes the other one.
+	Task<void> ping_pong(std::size_t count)
+	{
+		AsyncSemaphore ping(1);
+		AsyncSemaphore pong(0);
+		co_await all(volley(ping, pong, count), volley(pong, ping, count));
+	}
+
+	/// `pairs` producers push and as many consumers pop `count` items in total.
+	double queue_contention(std::size_t pairs, std::size_t count)
+	{
+		lockfree::Queue<std::uint64_t> queue(1024);
+		std::barrier start(static_cast<std::ptrdiff_t>(pairs * 2 + 1));
+		std::vector<std::thread> threads;
+		const std::size_t share = count / pairs;
+
+		for (std::size_t i = 0; i < pairs; i++)
+		{
+			threads.emplace_back([&]() {
+				start.arrive_and_wait();
+
+				for (std::size_t j = 0; j < share; j++)
+					queue.push(j);
+			});
+
+			threads.emplace_back([&]() {
+				start.arrive_and_wait();
+				std::uint64_t value = 0;
+
+				for (std::size_t j = 0; j < share; j++)
+					queue.pop(value);
+			});
+		}
+
+		start.arrive_and_wait();
+		const auto begin = Clock::now();
+
+		for (auto& t : threads)
+			t.join();
+
+		return std::chrono::duration<double>(Clock::now() - begin).count();
+	}
+
+	Task<void> read_whole(std::string path, std::size_t size)
+	{
+		auto data = co_await readFile(path);
+
+		if (data.size() != size)
+			throw std::runtime_error("short read");
+	}
+
+#ifdef __linux__
+	Task<void> read_chunked(std::string path, std::size_t size)
+	{
+		FileReader reader(path, std::make_shared<BufferPool>());
+		std::size_t total = 0;
+
+		while (auto chunk = co_await reader.next())
+			total += chunk->data.size();
+
+		if (total != size)
+			throw std::runtime_error("short read");
+	}
+
+	/// Touches one byte per page so the mapping is actually read.
+	Task<void> read_mapped(std::string path, std::size_t size)
+	{
+		auto file = co_await mapFile(path, MapAdvice::sequential);
+		std::uint64_t sum = 0;
+
+		for (std::size_t i = 0; i < file.size(); i += 4096)
+			sum += static_cast<unsigned char>(file.data()[i]);
+
+		if (file.size() != size || sum == std::numeric_limits<std::uint64_t>::max())
+			throw std::runtime_error("short read");
+	}
+#endif
+
+	/// Remembers the size of the last frame it allocated, see frame_size().
+	struct SizeProbe
+	{
+		static inline std::size_t last = 0;
+
+		static void* alloc(std::size_t size)
+		{
+			last = size;
+			return ::malloc(size);
+		}
+
+		static void free(void* ptr) { ::free(ptr); }
+	};
+
+	Task<std::uint64_t, SizeProbe> probe_value()
+	{
+		co_return 1;
+	}
+
+	Task<std::uint64_t, SizeProbe> probe_await()
+	{
+		co_return co_await probe_value() + 1;
+	}
+
+	Task<void, SizeProbe> probe_all()
+	{
+		std::vector<Task<void>> children;
+		co_await all(std::move(children));
+	}
+
+	Task<void, SizeProbe> probe_sleep()
+	{
+		co_await sleep_for(std::chrono::milliseconds(1));
+	}
+
+	/// Creates the coroutine without starting it, its frame is all we want.
+	template<typename Make>
+	std::size_t frame_size(Make make)
+	{
+		auto task = make();
+		const std::size_t size = SizeProbe::last;
+		task.handle.destroy();
+		return size;
+	}
+
+	void print_sizes(std::ostream& out, Format format)
+	{
+		const std::pair<const char*, std::size_t> sizes[] = {
+			{ "promise_base", sizeof(PromiseBase) },
+			{ "frame.leaf_void", frame_size(empty<SizeProbe>) },
+			{ "frame.leaf_value", frame_size(probe_value) },
+			{ "frame.await_one", frame_size(probe_await) },
+			{ "frame.await_all", frame_size(probe_all) },
+			{ "frame.sleep", frame_size(probe_sleep) },
+		};
+
+		if (format == Format::csv)
+			out << "name,bytes" << std::endl;
+
+		for (const auto& [name, bytes] : sizes)
+		{
+			if (format == Format::csv)
+				out << name << ',' << bytes << std::endl;
+			else
+				out << "{\"name\":\"" << name << "\",\"bytes\":" << bytes << "}" << std::endl;
+		}
+	}
+
+	std::vector<std::size_t> parse_list(const std::string& text)
+	{
+		std::vector<std::size_t> values;
+		std::stringstream stream(text);
+		std::string item;
+
+		while (std::getline(stream, item, ','))
+			values.push_back(std::stoull(item));
+
+		return values;
+	}
+
+	std::vector<std::size_t> default_threads()
+	{
+		const std::size_t hardware = std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+		std::vector<std::size_t> threads;
+
+		for (std::size_t t = 1; t < hardware; t *= 2)
+			threads.push_back(t);
+
+		threads.push_back(hardware);
+		return threads;
+	}
+
+	void usage()
+	{
+		std::cerr <<
+			"usage: tasky_bench [options]\n"
+			"  --threads=1,2,4     thread counts to sweep (default: powers of two up to the core count)\n"
+			"  --repetitions=N     timed repetitions per benchmark (default: 10)\n"
+			"  --filter=TEXT       only run benchmarks whose name contains TEXT\n"
+			"  --format=jsonl|csv  output format (default: jsonl)\n"
+			"  --dir=PATH          where the scratch file for the I/O benchmarks goes\n"
+			"  --file-size=MiB     size of that file (default: 64)\n"
+			"  --pinned            pin the workers to CPUs spread over the NUMA nodes\n"
+			"  --sizes             print the size of typical coroutine frames and exit\n";
+	}
+
+	bool parse(int argc, char* argv[], Options& options)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const std::string_view arg = argv[i];
+			const std::size_t equals = arg.find('=');
+			const std::string_view key = arg.substr(0, equals);
+			const std::string value = equals == std::string_view::npos ? "" : std::string(arg.substr(equals + 1));
+
+			if (key == "--threads")
+				options.threads = parse_list(value);
+			else if (key == "--repetitions")
+				options.repetitions = std::max<std::size_t>(std::stoull(value), 1);
+			else if (key == "--filter")
+				options.filter = value;
+			else if (key == "--format" && (value == "jsonl" || value == "csv"))
+				options.format = value == "csv" ? Format::csv : Format::jsonl;
+			else if (key == "--dir")
+				options.directory = value;
+			else if (key == "--file-size")
+				options.file_size = std::stoull(value) * 1024 * 1024;
+			else if (key == "--pinned")
+				options.placement = Placement::pinned;
+			else if (key == "--sizes")
+				options.sizes = true;
+			else
+				return false;
+		}
+
+		if (options.threads.empty())
+			options.threads = default_threads();
+
+		return std::find(options.threads.begin(), options.threads.end(), 0) == options.threads.end();
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+
+	try
+	{
+		if (!parse(argc, argv, options))
+		{
+			usage();
+			return 2;
+		}
+	}
+	catch (const std::exception&)
+	{
+		usage();
+		return 2;
+	}
+
+	// the scheduler announces itself on std::cout, keep that out of the results
+	std::ostream out(std::cout.rdbuf());
+	std::cout.rdbuf(nullptr);
+
+	if (options.sizes)
+	{
+		print_sizes(out, options.format);
+		return 0;
+	}
+
+	const auto selected = [&](std::string_view name) { return name.find(options.filter) != std::string_view::npos; };
+	const auto report = [&](Result result) { print(out, options.format, std::move(result)); };
+
+	const std::filesystem::path path = options.directory / ("tasky_bench_" + std::to_string(Clock::now().time_since_epoch().count()) + ".bin");
+
+	try
+	{
+		print_header(out, options.format);
+
+		if (selected("file."))
+		{
+			std::ofstream file(path, std::ios::binary);
+			std::string block(1024 * 1024, 'x');
+
+			for (std::size_t written = 0; written < options.file_size; written += block.size())
+				file.write(block.data(), static_cast<std::streamsize>(std::min(block.size(), options.file_size - written)));
+		}
+
+		for (std::size_t threads : options.threads)
+		{
+			Scheduler scheduler(threads - 1, 1024, options.placement);
+
+			if (selected("spawn.malloc"))
+				report(measure(options, "spawn.malloc", threads, min_items, min_items, "tasks", [&]() { return spawn<DefaultAllocator>(scheduler, min_items); }));
+
+			if (selected("spawn.frame_pool"))
+				report(measure(options, "spawn.frame_pool", threads, min_items, min_items, "tasks", [&]() { return spawn<FramePool>(scheduler, min_items); }));
+
+			if (selected("hop.self_spawn"))
+				report(measure(options, "hop.self_spawn", threads, min_items, min_items, "tasks", [&]() { return self_spawn<FramePool>(scheduler, min_items); }));
+
+			if (selected("hop.ping_pong"))
+				report(measure(options, "hop.ping_pong", threads, min_items, 2 * min_items, "hops", [&]() { return run_timed(scheduler, [=]() { return ping_pong(min_items); }); }));
+
+			for (std::size_t depth : { 1, 10, 100, 1000, 10000 })
+			{
+				const std::size_t count = std::max<std::size_t>(min_items / depth, 1);
+
+				if (selected("await_chain.malloc"))
+					report(measure(options, "await_chain.malloc", threads, depth, depth * count, "awaits", [&]() { return run_timed(scheduler, [=]() { return chains<DefaultAllocator>(depth, count); }); }));
+
+				if (selected("await_chain.frame_pool"))
+					report(measure(options, "await_chain.frame_pool", threads, depth, depth * count, "awaits", [&]() { return run_timed(scheduler, [=]() { return chains<FramePool>(depth, count); }); }));
+			}
+
+			for (std::size_t width : { 1, 10, 100, 1000, 10000, 100000 })
+			{
+				const std::size_t count = std::max<std::size_t>(min_items / width, 1);
+
+				if (selected("fan_out.malloc"))
+					report(measure(options, "fan_out.malloc", threads, width, width * count, "tasks", [&]() { return run_timed(scheduler, [=]() { return fan_out<DefaultAllocator>(width, count); }); }));
+
+				if (selected("fan_out.frame_pool"))
+					report(measure(options, "fan_out.frame_pool", threads, width, width * count, "tasks", [&]() { return run_timed(scheduler, [=]() { return fan_out<FramePool>(width, count); }); }));
+			}
+
+			if (selected("queue.contention"))
+			{
+				const std::size_t count = min_items / threads * threads;
+				report(measure(options, "queue.contention", threads, threads, count, "items", [&]() { return queue_contention(threads, count); }));
+			}
+
+			const std::string file = path.string();
+			const std::size_t size = options.file_size;
+
+			if (selected("file.read_file"))
+				report(measure(options, "file.read_file", threads, size, size, "bytes", [&]() { return run_timed(scheduler, [=]() { return read_whole(file, size); }); }));
+
+#ifdef __linux__
+			if (selected("file.reader"))
+				report(measure(options, "file.reader", threads, size, size, "bytes", [&]() { return run_timed(scheduler, [=]() { return read_chunked(file, size); }); }));
+
+			if (selected("file.map"))
+				report(measure(options, "file.map", threads, size, size, "bytes", [&]() { return run_timed(scheduler, [=]() { return read_mapped(file, size); }); }));
+#endif
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::filesystem::remove(path);
+		std::cerr << "Exception: " << e.what() << std::endl;
+		return 1;
+	}
+
+	std::filesystem::remove(path);
+	return 0;
+}
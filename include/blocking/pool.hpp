@@ -0,0 +1,160 @@
+#pragma once
+
+#include "pch.hpp"
+
+#include <list>
+
+namespace blocking
+{
+	/// Intrusive job, the pool only links it into its queue. The owner keeps it alive
+	/// until `run` is called, which may free it.
+	struct Job
+	{
+		using Run = void (*)(Job& job);
+
+		Run run = nullptr;
+
+		// owned by the pool
+		Job* next = nullptr;
+	};
+
+	/// Elastic pool of threads for calls that block: fsync, DNS lookups, compression
+	/// libraries, legacy APIs. A job goes to an idle thread if there is one, otherwise a
+	/// new thread is started, and only once `max_threads` are busy do jobs queue up, in
+	/// the order they came in. A thread that finds nothing to do for `keep_alive` exits,
+	/// so an unused pool shrinks back to no threads at all. The destructor waits for
+	/// every queued job to run.
+	class Pool
+	{
+	public:
+		explicit Pool(std::size_t max_threads = 512, std::chrono::milliseconds keep_alive = std::chrono::seconds(10)) :
+			max_threads_(std::max<std::size_t>(max_threads, 1)),
+			keep_alive_(keep_alive)
+		{}
+
+		~Pool() noexcept
+		{
+			std::vector<std::thread> retired;
+			{
+				std::unique_lock lock(mutex_);
+				stopping_ = true;
+				work_cv_.notify_all();
+				exit_cv_.wait(lock, [this]() { return threads_.empty(); });
+				retired.swap(retired_);
+			}
+
+			for (auto& t : retired)
+				t.join();
+		}
+
+		// non-copyable and non-movable
+		Pool(const Pool&) = delete;
+		Pool& operator=(const Pool&) = delete;
+
+		/// Runs the job on a pool thread, starting one if none is idle.
+		void submit(Job& job)
+		{
+			std::vector<std::thread> retired;
+			{
+				std::scoped_lock lock(mutex_);
+				job.next = nullptr;
+
+				if (tail_ != nullptr)
+					tail_->next = &job;
+				else
+					head_ = &job;
+
+				tail_ = &job;
+				queued_++;
+
+				if (queued_ <= idle_)
+					work_cv_.notify_one();
+				else if (threads_.size() < max_threads_)
+					start();
+
+				retired.swap(retired_);
+			}
+
+			// threads that timed out are on their way out, joining them is quick
+			for (auto& t : retired)
+				t.join();
+		}
+
+		/// Threads alive right now, busy or idle.
+		[[nodiscard]] std::size_t thread_count() const
+		{
+			std::scoped_lock lock(mutex_);
+			return threads_.size();
+		}
+
+		/// Jobs waiting for a thread, only ever more than 0 once every thread is busy.
+		[[nodiscard]] std::size_t queue_size() const
+		{
+			std::scoped_lock lock(mutex_);
+			return queued_;
+		}
+
+		[[nodiscard]] std::size_t max_threads() const noexcept { return max_threads_; }
+
+	private:
+		/// Called with the lock held. The thread needs the lock before it looks at its
+		/// own entry, so the entry is filled in by the time it does.
+		void start()
+		{
+			auto self = threads_.emplace(threads_.end());
+			*self = std::thread([this, self]() { run_thread(self); });
+		}
+
+		void run_thread(std::list<std::thread>::iterator self)
+		{
+			std::unique_lock lock(mutex_);
+
+			for (;;)
+			{
+				if (head_ != nullptr)
+				{
+					Job* job = std::exchange(head_, head_->next);
+
+					if (head_ == nullptr)
+						tail_ = nullptr;
+
+					queued_--;
+					lock.unlock();
+					job->run(*job);
+					lock.lock();
+					continue;
+				}
+
+				if (stopping_)
+					break;
+
+				idle_++;
+				const bool woken = work_cv_.wait_for(lock, keep_alive_, [this]() { return head_ != nullptr || stopping_; });
+				idle_--;
+
+				if (!woken)
+					break;
+			}
+
+			// the thread cannot join itself, the next submit() or the destructor does
+			retired_.push_back(std::move(*self));
+			threads_.erase(self);
+
+			if (stopping_)
+				exit_cv_.notify_all();
+		}
+
+		const std::size_t max_threads_;
+		const std::chrono::milliseconds keep_alive_;
+		mutable std::mutex mutex_;
+		std::condition_variable work_cv_;
+		std::condition_variable exit_cv_;
+		std::list<std::thread> threads_ = {};
+		std::vector<std::thread> retired_ = {};
+		Job* head_ = nullptr;
+		Job* tail_ = nullptr;
+		std::size_t queued_ = 0;
+		std::size_t idle_ = 0;
+		bool stopping_ = false;
+	};
+}
@@ -0,0 +1,674 @@
+#pragma once
+
+#include "pch.hpp"
+
+#ifdef __linux__
+
+#include <linux/io_uring.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace io
+{
+	/// A read or write at an offset, or a blocking call (`work`) to run off the workers.
+	/// Once it is done the reactor calls `callback` with the number of bytes transferred
+	/// (or whatever `work` returned) or a negative errno, from the thread that polled it.
+	struct Request
+	{
+		enum class Op : std::uint8_t
+		{
+			read,
+			write,
+			call
+		};
+
+		using Callback = void (*)(Request& request, std::int64_t result);
+		using Work = std::int64_t (*)(Request& request);
+
+		Callback callback = nullptr;
+		Work work = nullptr;
+		Op op = Op::read;
+		int fd = -1;
+		void* buffer = nullptr;
+		std::size_t length = 0;
+		std::uint64_t offset = 0;
+
+		// filled in by the pool
+		std::int64_t result = 0;
+
+		// owned by the reactor, see Reactor::cancel()
+		bool cancelled = false;
+		bool submitted = false;
+	};
+
+	enum class Backend
+	{
+		automatic,
+		io_uring,
+		thread_pool
+	};
+
+	/// Completion based I/O. Requests are executed by io_uring when the kernel allows it,
+	/// otherwise by a small pool of threads doing blocking pread/pwrite whose completions
+	/// are signalled through an eventfd watched by epoll. Blocking calls always go to the
+	/// pool, which is started on first use. Submissions are staged until flush(), so a
+	/// burst of requests costs a single syscall. Either way completions are only delivered
+	/// from poll(), which the scheduler's run loop drives.
+	class Reactor
+	{
+	public:
+		explicit Reactor(Backend backend = Backend::automatic, unsigned entries = 256)
+		{
+			event_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+			if (event_fd_ < 0)
+				throw std::runtime_error("Could not create eventfd!");
+
+			if (backend != Backend::thread_pool && setup_ring(entries))
+				return;
+
+			if (backend == Backend::io_uring)
+				throw std::runtime_error("Could not set up io_uring!");
+
+			setup_thread_pool();
+		}
+
+		~Reactor() noexcept
+		{
+			{
+				std::scoped_lock lock(jobs_mutex_);
+				stopping_ = true;
+			}
+
+			jobs_cv_.notify_all();
+
+			for (auto& t : pool_)
+				t.join();
+
+			if (uses_io_uring())
+			{
+				::munmap(sqes_, sqes_size_);
+				if (cq_ring_ != sq_ring_)
+					::munmap(cq_ring_, cq_ring_size_);
+				::munmap(sq_ring_, sq_ring_size_);
+				::close(ring_fd_);
+			}
+			else
+			{
+				::close(epoll_fd_);
+			}
+
+			::close(event_fd_);
+		}
+
+		// non-copyable and non-movable
+		Reactor(const Reactor&) = delete;
+		Reactor& operator=(const Reactor&) = delete;
+
+		[[nodiscard]] bool uses_io_uring() const noexcept { return ring_fd_ >= 0; }
+
+		/// Number of submitted requests whose completion has not been delivered yet.
+		[[nodiscard]] std::size_t pending() const noexcept { return pending_.load(std::memory_order::acquire); }
+
+		/// Stages a request, it is not started before the next flush() or poll().
+		/// A request that was cancelled before completes with -ECANCELED right away.
+		void submit(Request& request)
+		{
+			if (!uses_io_uring() || request.op == Request::Op::call)
+			{
+				pending_.fetch_add(1, std::memory_order::acq_rel);
+
+				{
+					std::scoped_lock lock(jobs_mutex_);
+
+					if (request.cancelled)
+					{
+						complete_cancelled(request);
+						return;
+					}
+
+					if (pool_.empty())
+					{
+						for (std::size_t i = 0; i < pool_size; i++)
+							pool_.emplace_back([this]() { run_pool_thread(); });
+					}
+
+					jobs_.push_back(&request);
+				}
+
+				staged_jobs_.fetch_add(1, std::memory_order::release);
+				return;
+			}
+
+			io_uring_sqe sqe = {};
+			sqe.opcode = request.op == Request::Op::read ? IORING_OP_READ : IORING_OP_WRITE;
+			sqe.fd = request.fd;
+			sqe.addr = reinterpret_cast<std::uint64_t>(request.buffer);
+			sqe.len = static_cast<std::uint32_t>(std::min<std::size_t>(request.length, std::numeric_limits<std::uint32_t>::max()));
+			sqe.off = request.offset;
+			sqe.user_data = reinterpret_cast<std::uint64_t>(&request);
+
+			// counted only now, the fetch_sub in deliver() then orders our reads of the
+			// request before its callback, which is all a sanitizer can see of the ring
+			pending_.fetch_add(1, std::memory_order::acq_rel);
+
+			{
+				std::scoped_lock lock(submit_mutex_);
+
+				if (request.cancelled)
+				{
+					complete_cancelled(request);
+					return;
+				}
+
+				push(sqe);
+				request.submitted = true;
+			}
+
+			staged_sqes_.fetch_add(1, std::memory_order::release);
+		}
+
+		/// Asks for a request to be stopped. One that has not been submitted yet completes
+		/// with -ECANCELED once it is, so does one still queued for the thread pool; the
+		/// kernel is asked to cancel one in flight on the ring. A read or write the pool
+		/// already started runs to the end. Either way the callback still runs exactly
+		/// once. The request must stay alive until this returns, and stays cancelled.
+		void cancel(Request& request)
+		{
+			if (!uses_io_uring() || request.op == Request::Op::call)
+			{
+				std::scoped_lock lock(jobs_mutex_);
+				request.cancelled = true;
+
+				auto it = std::find(jobs_.begin(), jobs_.end(), &request);
+
+				if (it != jobs_.end())
+				{
+					jobs_.erase(it);
+					complete_cancelled(request);
+				}
+
+				return;
+			}
+
+			std::scoped_lock lock(submit_mutex_);
+			request.cancelled = true;
+
+			if (!request.submitted)
+				return;
+
+			// a request that already finished is not found, its completion is unaffected
+			io_uring_sqe sqe = {};
+			sqe.opcode = IORING_OP_ASYNC_CANCEL;
+			sqe.addr = reinterpret_cast<std::uint64_t>(&request);
+			sqe.user_data = cancel_tag;
+			push(sqe);
+			submit_sqes();
+		}
+
+		/// Starts everything staged since the last flush: one io_uring_enter for the ring,
+		/// one wake up of the pool for the thread pool.
+		void flush()
+		{
+			if (staged_sqes_.load(std::memory_order::relaxed) > 0 && staged_sqes_.exchange(0, std::memory_order::acquire) > 0)
+			{
+				std::scoped_lock lock(submit_mutex_);
+				submit_sqes();
+
+				// the kernel was busy, try again with the next flush
+				if (unsubmitted_ > 0)
+					staged_sqes_.fetch_add(1, std::memory_order::relaxed);
+			}
+
+			if (staged_jobs_.load(std::memory_order::relaxed) > 0)
+			{
+				if (staged_jobs_.exchange(0, std::memory_order::acquire) > 1)
+					jobs_cv_.notify_all();
+				else
+					jobs_cv_.notify_one();
+			}
+		}
+
+		/// Delivers finished requests, returns how many. With `block` set it waits until at
+		/// least one request finishes, wake() is called or `deadline` passes. Only one
+		/// thread polls at a time, the others return 0 right away.
+		std::size_t poll(bool block, std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max())
+		{
+			std::unique_lock lock(poll_mutex_, std::try_to_lock);
+
+			if (!lock.owns_lock())
+				return 0;
+
+			return uses_io_uring() ? poll_ring(block, deadline, lock) : poll_thread_pool(block, deadline, lock);
+		}
+
+		/// Makes a blocking poll() return.
+		void wake() noexcept
+		{
+			::eventfd_write(event_fd_, 1);
+		}
+
+	private:
+		static constexpr std::uint64_t wake_tag = 0;
+		static constexpr std::uint64_t timeout_tag = 1;
+		static constexpr std::uint64_t cancel_tag = 2;
+		static constexpr std::size_t max_batch = 64;
+
+		struct Completion
+		{
+			Request* request;
+			std::int64_t result;
+		};
+
+		bool setup_ring(unsigned entries)
+		{
+			io_uring_params params = {};
+			const int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+
+			if (fd < 0)
+				return false;
+
+			// the ring predates the opcodes we need (READ and WRITE came with 5.6), on
+			// older kernels every request would fail with -EINVAL
+			if (!supports_ops(fd, (params.features & IORING_FEAT_EXT_ARG) != 0))
+			{
+				::close(fd);
+				return false;
+			}
+
+			sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+
+			const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+			if (single_mmap)
+				sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+
+			sq_ring_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+
+			if (sq_ring_ == MAP_FAILED)
+			{
+				::close(fd);
+				return false;
+			}
+
+			cq_ring_ = single_mmap ? sq_ring_ : ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+			void* sqes = cq_ring_ == MAP_FAILED ? MAP_FAILED : ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+			if (cq_ring_ == MAP_FAILED || sqes == MAP_FAILED)
+			{
+				if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+					::munmap(cq_ring_, cq_ring_size_);
+				::munmap(sq_ring_, sq_ring_size_);
+				::close(fd);
+				return false;
+			}
+
+			sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+			auto* sq = static_cast<std::byte*>(sq_ring_);
+			auto* cq = static_cast<std::byte*>(cq_ring_);
+
+			sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+			sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+			sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+			sq_entries_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+			sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+			cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+			cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+			cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+			cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+			ext_arg_ = (params.features & IORING_FEAT_EXT_ARG) != 0;
+			ring_fd_ = fd;
+
+			std::scoped_lock lock(submit_mutex_);
+			arm_wake();
+			submit_sqes();
+			return true;
+		}
+
+		/// Asks the kernel which opcodes the ring takes. Probing itself needs 5.6, so an
+		/// older kernel fails here too.
+		static bool supports_ops(int fd, bool ext_arg)
+		{
+			constexpr unsigned probe_ops = 256;
+			std::vector<std::byte> buffer(sizeof(io_uring_probe) + probe_ops * sizeof(io_uring_probe_op));
+			auto* probe = reinterpret_cast<io_uring_probe*>(buffer.data());
+
+			if (::syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, probe_ops) < 0)
+				return false;
+
+			const auto supported = [probe](unsigned op) { return op < probe->ops_len && (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0; };
+
+			// without EXT_ARG a timed wait submits a TIMEOUT, see wait_ring()
+			return supported(IORING_OP_READ) && supported(IORING_OP_WRITE) && supported(IORING_OP_ASYNC_CANCEL) &&
+				(ext_arg || supported(IORING_OP_TIMEOUT));
+		}
+
+		void setup_thread_pool()
+		{
+			epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+
+			if (epoll_fd_ < 0)
+				throw std::runtime_error("Could not create epoll instance!");
+
+			epoll_event event = {};
+			event.events = EPOLLIN;
+			event.data.fd = event_fd_;
+
+			if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &event) < 0)
+				throw std::runtime_error("Could not watch eventfd!");
+		}
+
+		/// Queues an sqe, submit_mutex_ must be held.
+		void push(const io_uring_sqe& sqe)
+		{
+			unsigned tail = *sq_tail_;
+
+			// without SQPOLL the kernel consumes everything it is handed right away
+			while (tail - std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order::acquire) >= sq_entries_)
+			{
+				submit_sqes();
+				std::this_thread::yield();
+			}
+
+			const unsigned index = tail & sq_mask_;
+			sqes_[index] = sqe;
+			sq_array_[index] = index;
+			std::atomic_ref<unsigned>(*sq_tail_).store(tail + 1, std::memory_order::release);
+			unsubmitted_++;
+		}
+
+		/// Hands queued sqes to the kernel, submit_mutex_ must be held. When the kernel is
+		/// busy they stay queued and go out with the next flush.
+		void submit_sqes() noexcept
+		{
+			while (unsubmitted_ > 0)
+			{
+				const long submitted = ::syscall(__NR_io_uring_enter, ring_fd_, unsubmitted_, 0, 0, nullptr, 0);
+
+				if (submitted < 0)
+				{
+					if (errno == EINTR)
+						continue;
+					return;
+				}
+
+				unsubmitted_ -= static_cast<unsigned>(submitted);
+			}
+		}
+
+		/// Keeps a read on the eventfd in flight so wake() produces a completion.
+		void arm_wake()
+		{
+			io_uring_sqe sqe = {};
+			sqe.opcode = IORING_OP_READ;
+			sqe.fd = event_fd_;
+			sqe.addr = reinterpret_cast<std::uint64_t>(&wake_buffer_);
+			sqe.len = sizeof(wake_buffer_);
+			sqe.user_data = wake_tag;
+			push(sqe);
+		}
+
+		/// Waits for a completion, or until `deadline` if there is one.
+		void wait_ring(std::chrono::steady_clock::time_point deadline)
+		{
+			if (deadline == std::chrono::steady_clock::time_point::max())
+			{
+				::syscall(__NR_io_uring_enter, ring_fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+				return;
+			}
+
+			const auto timeout = std::max(std::chrono::nanoseconds(deadline - std::chrono::steady_clock::now()), std::chrono::nanoseconds(0));
+			__kernel_timespec ts = {};
+			ts.tv_sec = timeout.count() / 1000000000;
+			ts.tv_nsec = timeout.count() % 1000000000;
+
+			if (ext_arg_)
+			{
+				io_uring_getevents_arg arg = {};
+				arg.ts = reinterpret_cast<std::uint64_t>(&ts);
+				::syscall(__NR_io_uring_enter, ring_fd_, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+				return;
+			}
+
+			// older kernels: a timeout request completes the wait, the kernel copies `ts`
+			// while the sqe is submitted and a late completion is ignored
+			io_uring_sqe sqe = {};
+			sqe.opcode = IORING_OP_TIMEOUT;
+			sqe.addr = reinterpret_cast<std::uint64_t>(&ts);
+			sqe.len = 1;
+			sqe.user_data = timeout_tag;
+			{
+				std::scoped_lock lock(submit_mutex_);
+				push(sqe);
+				submit_sqes();
+			}
+
+			::syscall(__NR_io_uring_enter, ring_fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+		}
+
+		std::size_t poll_ring(bool block, std::chrono::steady_clock::time_point deadline, std::unique_lock<std::mutex>& lock)
+		{
+			flush();
+
+			std::atomic_ref<unsigned> cq_tail(*cq_tail_);
+			unsigned head = *cq_head_;
+
+			if (block && head == cq_tail.load(std::memory_order::acquire))
+				wait_ring(deadline);
+
+			Completion completions[max_batch];
+			std::size_t count = 0;
+			bool woken = false;
+			const unsigned tail = cq_tail.load(std::memory_order::acquire);
+
+			for (; head != tail && count < max_batch; head++)
+			{
+				const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+
+				if (cqe.user_data == wake_tag)
+					woken = true;
+				else if (cqe.user_data != timeout_tag && cqe.user_data != cancel_tag)
+					completions[count++] = { reinterpret_cast<Request*>(cqe.user_data), cqe.res };
+			}
+
+			std::atomic_ref<unsigned>(*cq_head_).store(head, std::memory_order::release);
+			count += take_done(completions + count, max_batch - count);
+			lock.unlock();
+
+			if (woken)
+			{
+				std::scoped_lock submit_lock(submit_mutex_);
+				arm_wake();
+				submit_sqes();
+			}
+
+			return deliver(completions, count);
+		}
+
+		std::size_t poll_thread_pool(bool block, std::chrono::steady_clock::time_point deadline, std::unique_lock<std::mutex>& lock)
+		{
+			flush();
+
+			bool ready = false;
+			{
+				std::scoped_lock done_lock(done_mutex_);
+				ready = !done_.empty();
+			}
+
+			int timeout = 0;
+
+			if (block && !ready)
+			{
+				if (deadline == std::chrono::steady_clock::time_point::max())
+				{
+					timeout = -1;
+				}
+				else
+				{
+					const auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+					timeout = static_cast<int>(std::clamp<std::int64_t>(left.count(), 0, std::numeric_limits<int>::max()));
+				}
+			}
+
+			epoll_event events[4];
+			if (::epoll_wait(epoll_fd_, events, 4, timeout) > 0)
+			{
+				eventfd_t value = 0;
+				::eventfd_read(event_fd_, &value);
+			}
+
+			Completion completions[max_batch];
+			const std::size_t count = take_done(completions, max_batch);
+			lock.unlock();
+			return deliver(completions, count);
+		}
+
+		/// Hands a request that never started back through poll(), the pending count
+		/// already includes it.
+		void complete_cancelled(Request& request)
+		{
+			request.result = -ECANCELED;
+			{
+				std::scoped_lock lock(done_mutex_);
+				done_.push_back(&request);
+			}
+
+			wake();
+		}
+
+		/// Collects requests finished by the pool and cancelled ones.
+		std::size_t take_done(Completion* completions, std::size_t max)
+		{
+			std::scoped_lock done_lock(done_mutex_);
+			std::size_t count = 0;
+
+			while (!done_.empty() && count < max)
+			{
+				Request* request = done_.front();
+				done_.pop_front();
+				completions[count++] = { request, request->result };
+			}
+
+			return count;
+		}
+
+		std::size_t deliver(const Completion* completions, std::size_t count)
+		{
+			pending_.fetch_sub(count, std::memory_order::acq_rel);
+
+			for (std::size_t i = 0; i < count; i++)
+				completions[i].request->callback(*completions[i].request, completions[i].result);
+
+			return count;
+		}
+
+		/// Takes a share of the queued jobs at a time and hands their completions back
+		/// together, so a burst costs a few lock round trips and wake ups instead of one
+		/// per request.
+		void run_pool_thread()
+		{
+			Request* batch[pool_batch];
+
+			for (;;)
+			{
+				std::size_t count = 0;
+				{
+					std::unique_lock lock(jobs_mutex_);
+					jobs_cv_.wait(lock, [this]() { return stopping_ || !jobs_.empty(); });
+
+					if (jobs_.empty())
+						return;
+
+					const std::size_t share = std::clamp<std::size_t>(jobs_.size() / pool_.size(), 1, pool_batch);
+
+					for (; count < share; count++)
+					{
+						batch[count] = jobs_.front();
+						jobs_.pop_front();
+					}
+				}
+
+				for (std::size_t i = 0; i < count; i++)
+					execute(*batch[i]);
+
+				{
+					std::scoped_lock lock(done_mutex_);
+					done_.insert(done_.end(), batch, batch + count);
+				}
+
+				wake();
+			}
+		}
+
+		static void execute(Request& request)
+		{
+			if (request.op == Request::Op::call)
+			{
+				request.result = request.work(request);
+				return;
+			}
+
+			ssize_t result = 0;
+			do
+			{
+				if (request.op == Request::Op::read)
+					result = ::pread(request.fd, request.buffer, request.length, static_cast<off_t>(request.offset));
+				else
+					result = ::pwrite(request.fd, request.buffer, request.length, static_cast<off_t>(request.offset));
+			} while (result < 0 && errno == EINTR);
+
+			request.result = result < 0 ? -errno : result;
+		}
+
+		static constexpr std::size_t pool_size = 4;
+		static constexpr std::size_t pool_batch = 16;
+
+		int event_fd_ = -1;
+		std::atomic<std::size_t> pending_ = 0;
+		std::mutex poll_mutex_;
+
+		// io_uring
+		int ring_fd_ = -1;
+		void* sq_ring_ = nullptr;
+		void* cq_ring_ = nullptr;
+		io_uring_sqe* sqes_ = nullptr;
+		std::size_t sq_ring_size_ = 0;
+		std::size_t cq_ring_size_ = 0;
+		std::size_t sqes_size_ = 0;
+		unsigned* sq_head_ = nullptr;
+		unsigned* sq_tail_ = nullptr;
+		unsigned* sq_array_ = nullptr;
+		unsigned sq_mask_ = 0;
+		unsigned sq_entries_ = 0;
+		unsigned* cq_head_ = nullptr;
+		unsigned* cq_tail_ = nullptr;
+		unsigned cq_mask_ = 0;
+		io_uring_cqe* cqes_ = nullptr;
+		bool ext_arg_ = false;
+		std::mutex submit_mutex_;
+		unsigned unsubmitted_ = 0;
+		std::atomic<std::size_t> staged_sqes_ = 0;
+		eventfd_t wake_buffer_ = 0;
+
+		// epoll + thread pool
+		int epoll_fd_ = -1;
+		std::vector<std::thread> pool_ = {};
+		std::mutex jobs_mutex_;
+		std::condition_variable jobs_cv_;
+		std::deque<Request*> jobs_ = {};
+		std::atomic<std::size_t> staged_jobs_ = 0;
+		bool stopping_ = false;
+		std::mutex done_mutex_;
+		std::deque<Request*> done_ = {};
+	};
+}
+
+#endif
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "pch.hpp"
+#include "lockfree/queue.hpp"
+
+namespace lockfree
+{
+	/// Chase-Lev work-stealing deque (see "Correct and Efficient Work-Stealing for
+	/// Weak Memory Models", Lê et al. 2013).
+	/// The owning thread pushes and pops at the bottom, any other thread may steal
+	/// from the top. The buffer grows when full; retired buffers are kept alive until
+	/// the deque is destroyed because stealers may still be reading from them.
+	template<typename T>
+	class WorkStealingDeque
+	{
+	private:
+		static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+
+		struct Buffer
+		{
+			explicit Buffer(const std::int64_t capacity) : capacity(capacity), mask(capacity - 1), slots(new std::atomic<T>[static_cast<std::size_t>(capacity)]) {}
+
+			T get(std::int64_t i) const noexcept { return slots[i & mask].load(std::memory_order_relaxed); }
+
+			void put(std::int64_t i, T v) noexcept { slots[i & mask].store(v, std::memory_order_relaxed); }
+
+			const std::int64_t capacity;
+			const std::int64_t mask;
+			std::unique_ptr<std::atomic<T>[]> slots;
+		};
+
+	public:
+		explicit WorkStealingDeque(const std::size_t capacity = 256) : top_(0), bottom_(0)
+		{
+			if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+				throw std::invalid_argument("capacity must be a power of two >= 2");
+
+			buffers_.emplace_back(std::make_unique<Buffer>(static_cast<std::int64_t>(capacity)));
+			buffer_.store(buffers_.back().get(), std::memory_order_relaxed);
+		}
+
+		// non-copyable and non-movable
+		WorkStealingDeque(const WorkStealingDeque&) = delete;
+		WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+		/// Owner only.
+		void push(T v)
+		{
+			const std::int64_t b = bottom_.load(std::memory_order_relaxed);
+			const std::int64_t t = top_.load(std::memory_order_acquire);
+			Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+
+			if (b - t > buffer->capacity - 1)
+				buffer = grow(buffer, b, t);
+
+			buffer->put(b, v);
+			bottom_.store(b + 1, std::memory_order_release);
+		}
+
+		/// Owner only. Pushes `count` elements and publishes them with a single store, so
+		/// stealers see the whole batch at once.
+		void push_n(const T* values, std::size_t count)
+		{
+			if (count == 0)
+				return;
+
+			const std::int64_t b = bottom_.load(std::memory_order_relaxed);
+			const std::int64_t t = top_.load(std::memory_order_acquire);
+			const std::int64_t n = static_cast<std::int64_t>(count);
+			Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+
+			while (b - t + n > buffer->capacity)
+				buffer = grow(buffer, b, t);
+
+			for (std::int64_t i = 0; i < n; i++)
+				buffer->put(b + i, values[i]);
+
+			bottom_.store(b + n, std::memory_order_release);
+		}
+
+		/// Owner only. Returns false when the deque is empty or the last element was stolen.
+		bool try_pop(T& v) noexcept
+		{
+			const std::int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+			Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+			bottom_.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			std::int64_t t = top_.load(std::memory_order_relaxed);
+
+			if (t > b)
+			{
+				bottom_.store(b + 1, std::memory_order_relaxed);
+				return false;
+			}
+
+			v = buffer->get(b);
+
+			if (t == b)
+			{
+				// last element, race against stealers for it
+				const bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+				bottom_.store(b + 1, std::memory_order_relaxed);
+				return won;
+			}
+
+			return true;
+		}
+
+		/// Any thread. Returns false when the deque is empty or another thread won the race.
+		bool try_steal(T& v) noexcept
+		{
+			std::int64_t t = top_.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const std::int64_t b = bottom_.load(std::memory_order_acquire);
+
+			if (t >= b)
+				return false;
+
+			Buffer* buffer = buffer_.load(std::memory_order_acquire);
+			v = buffer->get(t);
+			return top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+		}
+
+		/// Best effort guess, see Queue::size().
+		std::ptrdiff_t size() const noexcept
+		{
+			return static_cast<std::ptrdiff_t>(bottom_.load(std::memory_order_relaxed) - top_.load(std::memory_order_relaxed));
+		}
+
+		bool empty() const noexcept { return size() <= 0; }
+
+	private:
+		Buffer* grow(Buffer* old, std::int64_t b, std::int64_t t)
+		{
+			buffers_.emplace_back(std::make_unique<Buffer>(old->capacity * 2));
+			Buffer* buffer = buffers_.back().get();
+
+			for (std::int64_t i = t; i < b; i++)
+				buffer->put(i, old->get(i));
+
+			buffer_.store(buffer, std::memory_order_release);
+			return buffer;
+		}
+
+		alignas(hardwareInterferenceSize) std::atomic<std::int64_t> top_;
+		alignas(hardwareInterferenceSize) std::atomic<std::int64_t> bottom_;
+		alignas(hardwareInterferenceSize) std::atomic<Buffer*> buffer_ = nullptr;
+		std::vector<std::unique_ptr<Buffer>> buffers_ = {};
+	};
+}
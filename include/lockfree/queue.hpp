@@ -24,7 +24,8 @@ SOFTWARE.
 namespace lockfree
 {
 
-#if defined(__cpp_lib_hardware_interference_size) && !defined(__APPLE__)
+// GCC refuses (-Winterference-size) to let the value leak into headers as it depends on -mtune
+#if defined(__cpp_lib_hardware_interference_size) && !defined(__APPLE__) && !(defined(__GNUC__) && !defined(__clang__))
 	static constexpr size_t hardwareInterferenceSize = std::hardware_destructive_interference_size;
 #else
 	static constexpr size_t hardwareInterferenceSize = 64;
@@ -135,6 +136,11 @@ namespace lockfree
 			auto head = head_.load(std::memory_order_acquire);
 			for (;;)
 			{
+				if (head & closedBit)
+				{
+					return false;
+				}
+
 				auto& slot = slots_[idx(head)];
 				if (turn(head) * 2 == slot.turn.load(std::memory_order_acquire))
 				{
@@ -220,13 +226,88 @@ namespace lockfree
 			}
 		}
 
+		/// Pushes up to `count` elements starting at `first` and returns how many made it.
+		/// The whole range is claimed with a single compare-exchange on the head, so
+		/// producers pushing many elements only contend once. Like try_push it never waits;
+		/// it stops at the first slot a consumer has not freed yet.
+		template <typename It>
+		size_t try_push_n(It first, size_t count) noexcept
+		{
+			static_assert(std::is_nothrow_constructible<T, decltype(*first)>::value, "T must be nothrow constructible from *first");
+			auto head = head_.load(std::memory_order_acquire);
+			for (;;)
+			{
+				if (head & closedBit)
+				{
+					return 0;
+				}
+
+				const size_t n = free_from(head, std::min(count, capacity_));
+				if (n == 0)
+				{
+					auto const prevHead = head;
+					head = head_.load(std::memory_order_acquire);
+					if (head == prevHead)
+					{
+						return 0;
+					}
+					continue;
+				}
+
+				if (head_.compare_exchange_strong(head, head + n))
+				{
+					for (size_t i = 0; i < n; ++i, ++first)
+					{
+						auto& slot = slots_[idx(head + i)];
+						slot.construct(*first);
+						slot.turn.store(turn(head + i) * 2 + 1, std::memory_order_release);
+					}
+					return n;
+				}
+			}
+		}
+
+		/// Pops up to `max` elements into `out` and returns how many, claiming them with a
+		/// single compare-exchange on the tail. Stops at the first slot whose producer has
+		/// not finished yet.
+		size_t try_pop_n(T* out, size_t max) noexcept
+		{
+			auto tail = tail_.load(std::memory_order_acquire);
+			for (;;)
+			{
+				const size_t n = filled_from(tail, std::min(max, capacity_));
+				if (n == 0)
+				{
+					auto const prevTail = tail;
+					tail = tail_.load(std::memory_order_acquire);
+					if (tail == prevTail)
+					{
+						return 0;
+					}
+					continue;
+				}
+
+				if (tail_.compare_exchange_strong(tail, tail + n))
+				{
+					for (size_t i = 0; i < n; ++i)
+					{
+						auto& slot = slots_[idx(tail + i)];
+						out[i] = slot.move();
+						slot.destroy();
+						slot.turn.store(turn(tail + i) * 2 + 2, std::memory_order_release);
+					}
+					return n;
+				}
+			}
+		}
+
 		/// Returns the number of elements in the queue.
 		/// The size can be negative when the queue is empty and there is at least one
 		/// reader waiting. Since this is a concurrent queue the size is only a best
 		/// effort guess until all reader and writer threads have been joined.
 		ptrdiff_t size() const noexcept
 		{
-			return static_cast<ptrdiff_t>(head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_relaxed));
+			return static_cast<ptrdiff_t>((head_.load(std::memory_order_relaxed) & ~closedBit) - tail_.load(std::memory_order_relaxed));
 		}
 
 		/// Returns true if the queue is empty.
@@ -234,11 +315,43 @@ namespace lockfree
 		/// until all reader and writer threads have been joined.
 		bool empty() const noexcept { return size() <= 0; }
 
+		size_t capacity() const noexcept { return capacity_; }
+
+		/// Makes every following try_emplace/try_push fail, elements already in the queue
+		/// can still be popped. Must not be mixed with the blocking emplace/push.
+		void close() noexcept { head_.fetch_or(closedBit, std::memory_order_acq_rel); }
+
+		bool closed() const noexcept { return (head_.load(std::memory_order_acquire) & closedBit) != 0; }
+
 	private:
+		static constexpr size_t closedBit = size_t(1) << (sizeof(size_t) * 8 - 1);
+
 		constexpr size_t idx(size_t i) const noexcept { return i % capacity_; }
 
 		constexpr size_t turn(size_t i) const noexcept { return i / capacity_; }
 
+		/// Number of consecutive slots from `head` (at most `max`) that are free to write.
+		size_t free_from(size_t head, size_t max) const noexcept
+		{
+			size_t n = 0;
+			while (n < max && turn(head + n) * 2 == slots_[idx(head + n)].turn.load(std::memory_order_acquire))
+			{
+				++n;
+			}
+			return n;
+		}
+
+		/// Number of consecutive slots from `tail` (at most `max`) that hold an element.
+		size_t filled_from(size_t tail, size_t max) const noexcept
+		{
+			size_t n = 0;
+			while (n < max && turn(tail + n) * 2 + 1 == slots_[idx(tail + n)].turn.load(std::memory_order_acquire))
+			{
+				++n;
+			}
+			return n;
+		}
+
 	private:
 		const size_t capacity_;
 		Slot<T>* slots_;
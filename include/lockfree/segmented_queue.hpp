@@ -0,0 +1,182 @@
+#pragma once
+
+#include "pch.hpp"
+#include "lockfree/queue.hpp"
+
+namespace lockfree
+{
+	/// Unbounded MPMC queue made of a linked list of bounded Queue segments.
+	/// While the current segment has room a push is a single Queue::try_push. When it
+	/// is full a segment of twice the size is linked behind it and the full one is
+	/// closed, consumers move on once a closed segment has been drained.
+	/// Drained segments stay allocated until the queue is destroyed (consumers may still
+	/// be looking at them); as segments double in size there are only a handful of them.
+	template <typename T>
+	class SegmentedQueue
+	{
+	private:
+		struct Segment
+		{
+			explicit Segment(const size_t capacity) : queue(capacity) {}
+
+			Queue<T> queue;
+			std::atomic<Segment*> next = nullptr;
+		};
+
+	public:
+		explicit SegmentedQueue(const size_t capacity) : first_(new Segment(capacity)), head_(first_), tail_(first_) {}
+
+		~SegmentedQueue() noexcept
+		{
+			Segment* segment = first_;
+			while (segment != nullptr)
+			{
+				Segment* next = segment->next.load(std::memory_order_relaxed);
+				delete segment;
+				segment = next;
+			}
+		}
+
+		// non-copyable and non-movable
+		SegmentedQueue(const SegmentedQueue&) = delete;
+		SegmentedQueue& operator=(const SegmentedQueue&) = delete;
+
+		template <typename P>
+		void push(P&& v)
+		{
+			for (;;)
+			{
+				Segment* tail = tail_.load(std::memory_order_acquire);
+
+				if (tail->queue.try_push(std::forward<P>(v)))
+				{
+					return;
+				}
+
+				grow(tail);
+			}
+		}
+
+		/// Pushes `count` elements starting at `first`, a segment at a time with one
+		/// Queue::try_push_n each.
+		template <typename It>
+		void push_n(It first, size_t count)
+		{
+			while (count > 0)
+			{
+				Segment* tail = tail_.load(std::memory_order_acquire);
+				const size_t pushed = tail->queue.try_push_n(first, count);
+
+				std::advance(first, pushed);
+				count -= pushed;
+
+				if (count > 0)
+				{
+					grow(tail);
+				}
+			}
+		}
+
+		bool try_pop(T& v) noexcept
+		{
+			for (;;)
+			{
+				Segment* head = head_.load(std::memory_order_acquire);
+
+				if (head->queue.try_pop(v))
+				{
+					return true;
+				}
+
+				Segment* next = head->next.load(std::memory_order_acquire);
+
+				if (next == nullptr)
+				{
+					return false;
+				}
+
+				// producers may still be finishing a push into the old segment
+				if (!head->queue.closed() || head->queue.size() > 0)
+				{
+					return next->queue.try_pop(v);
+				}
+
+				head_.compare_exchange_strong(head, next, std::memory_order_acq_rel);
+			}
+		}
+
+		/// Pops up to `max` elements into `out` and returns how many. They all come from the
+		/// same segment, so a batch may be short when it ends at a segment boundary.
+		size_t try_pop_n(T* out, size_t max) noexcept
+		{
+			for (;;)
+			{
+				Segment* head = head_.load(std::memory_order_acquire);
+				const size_t popped = head->queue.try_pop_n(out, max);
+
+				if (popped > 0)
+				{
+					return popped;
+				}
+
+				Segment* next = head->next.load(std::memory_order_acquire);
+
+				if (next == nullptr)
+				{
+					return 0;
+				}
+
+				// producers may still be finishing a push into the old segment
+				if (!head->queue.closed() || head->queue.size() > 0)
+				{
+					return next->queue.try_pop_n(out, max);
+				}
+
+				head_.compare_exchange_strong(head, next, std::memory_order_acq_rel);
+			}
+		}
+
+		/// Best effort guess, see Queue::size().
+		ptrdiff_t size() const noexcept
+		{
+			ptrdiff_t size = 0;
+			for (Segment* segment = head_.load(std::memory_order_acquire); segment != nullptr; segment = segment->next.load(std::memory_order_acquire))
+			{
+				size += std::max<ptrdiff_t>(segment->queue.size(), 0);
+			}
+			return size;
+		}
+
+		bool empty() const noexcept { return size() <= 0; }
+
+		/// Capacity of the segment currently taking pushes.
+		size_t capacity() const noexcept { return tail_.load(std::memory_order_acquire)->queue.capacity(); }
+
+	private:
+		void grow(Segment* tail)
+		{
+			Segment* next = tail->next.load(std::memory_order_acquire);
+
+			if (next == nullptr)
+			{
+				auto segment = std::make_unique<Segment>(tail->queue.capacity() * 2);
+
+				if (tail->next.compare_exchange_strong(next, segment.get(), std::memory_order_acq_rel))
+				{
+					next = segment.release();
+				}
+
+				// nobody may push into the old segment once consumers can move past it
+				tail->queue.close();
+			}
+
+			tail_.compare_exchange_strong(tail, next, std::memory_order_acq_rel);
+		}
+
+		Segment* const first_;
+
+		// Align to avoid false sharing between head_ and tail_
+		alignas(hardwareInterferenceSize) std::atomic<Segment*> head_;
+		alignas(hardwareInterferenceSize) std::atomic<Segment*> tail_;
+	};
+}
@@ -0,0 +1,273 @@
+#pragma once
+
+#include "pch.hpp"
+
+#ifdef _WIN32
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#endif
+
+namespace numa
+{
+	/// A memory node and the logical CPUs attached to it.
+	struct Node
+	{
+		std::size_t id = 0;
+		std::vector<std::size_t> cpus = {};
+	};
+
+	/// The CPUs this process may run on, grouped by NUMA node and sorted by node id.
+	/// Machines without NUMA information (and platforms we cannot read it on) show up as
+	/// a single node holding every CPU.
+	struct Topology
+	{
+		std::vector<Node> nodes = {};
+
+		[[nodiscard]] static Topology detect();
+
+		/// Index into `nodes` of the node the CPU belongs to.
+		[[nodiscard]] std::optional<std::size_t> node_of(std::size_t cpu) const noexcept
+		{
+			for (std::size_t i = 0; i < nodes.size(); i++)
+			{
+				if (std::find(nodes[i].cpus.begin(), nodes[i].cpus.end(), cpu) != nodes[i].cpus.end())
+					return i;
+			}
+
+			return std::nullopt;
+		}
+
+		[[nodiscard]] std::size_t cpu_count() const noexcept
+		{
+			std::size_t count = 0;
+
+			for (const Node& node : nodes)
+				count += node.cpus.size();
+
+			return count;
+		}
+	};
+
+	/// Restricts the calling thread to a single CPU, false when the OS refused.
+	inline bool pin_thread(std::size_t cpu) noexcept;
+
+	/// The CPU the calling thread is running on right now, if the OS tells.
+	[[nodiscard]] inline std::optional<std::size_t> current_cpu() noexcept;
+
+	/// Remembers the affinity of the calling thread and restores it when destroyed.
+	class SavedAffinity
+	{
+	public:
+		SavedAffinity() noexcept;
+		~SavedAffinity() noexcept;
+
+		SavedAffinity(const SavedAffinity&) = delete;
+		SavedAffinity& operator=(const SavedAffinity&) = delete;
+
+	private:
+#ifdef _WIN32
+		GROUP_AFFINITY affinity_ = {};
+#elif defined(__linux__)
+		cpu_set_t affinity_ = {};
+#endif
+		bool saved_ = false;
+	};
+
+#ifdef _WIN32
+	inline Topology Topology::detect()
+	{
+		Topology topology;
+		ULONG highest = 0;
+
+		if (::GetNumaHighestNodeNumber(&highest))
+		{
+			for (ULONG id = 0; id <= highest; id++)
+			{
+				GROUP_AFFINITY affinity = {};
+
+				if (!::GetNumaNodeProcessorMaskEx(static_cast<USHORT>(id), &affinity))
+					continue;
+
+				Node node{ .id = id };
+
+				for (std::size_t bit = 0; bit < sizeof(KAFFINITY) * 8; bit++)
+				{
+					if (affinity.Mask & (KAFFINITY(1) << bit))
+						node.cpus.push_back(affinity.Group * sizeof(KAFFINITY) * 8 + bit);
+				}
+
+				if (!node.cpus.empty())
+					topology.nodes.push_back(std::move(node));
+			}
+		}
+
+		if (topology.nodes.empty())
+		{
+			Node& node = topology.nodes.emplace_back();
+
+			for (std::size_t cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); cpu++)
+				node.cpus.push_back(cpu);
+		}
+
+		return topology;
+	}
+
+	inline bool pin_thread(std::size_t cpu) noexcept
+	{
+		GROUP_AFFINITY affinity = {};
+		affinity.Group = static_cast<WORD>(cpu / (sizeof(KAFFINITY) * 8));
+		affinity.Mask = KAFFINITY(1) << (cpu % (sizeof(KAFFINITY) * 8));
+		return ::SetThreadGroupAffinity(::GetCurrentThread(), &affinity, nullptr) != 0;
+	}
+
+	inline std::optional<std::size_t> current_cpu() noexcept
+	{
+		PROCESSOR_NUMBER number = {};
+		::GetCurrentProcessorNumberEx(&number);
+		return number.Group * sizeof(KAFFINITY) * 8 + number.Number;
+	}
+
+	inline SavedAffinity::SavedAffinity() noexcept : saved_(::GetThreadGroupAffinity(::GetCurrentThread(), &affinity_) != 0) {}
+
+	inline SavedAffinity::~SavedAffinity() noexcept
+	{
+		if (saved_)
+			::SetThreadGroupAffinity(::GetCurrentThread(), &affinity_, nullptr);
+	}
+#elif defined(__linux__)
+	/// Parses a sysfs CPU list such as "0-3,8-11".
+	inline std::vector<std::size_t> parse_cpu_list(std::string_view list)
+	{
+		std::vector<std::size_t> cpus;
+
+		while (!list.empty())
+		{
+			const std::size_t comma = list.find(',');
+			const std::string_view range = list.substr(0, comma);
+			list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+
+			std::size_t first = 0;
+			std::size_t last = 0;
+			const auto [end, error] = std::from_chars(range.data(), range.data() + range.size(), first);
+
+			if (error != std::errc())
+				continue;
+
+			last = first;
+
+			if (end != range.data() + range.size() && *end == '-')
+				std::from_chars(end + 1, range.data() + range.size(), last);
+
+			for (std::size_t cpu = first; cpu <= last; cpu++)
+				cpus.push_back(cpu);
+		}
+
+		return cpus;
+	}
+
+	inline Topology Topology::detect()
+	{
+		Topology topology;
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+
+		// cpusets and taskset can hide CPUs from us, those are no use
+		const bool masked = ::sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+		const auto usable = [&](std::size_t cpu) { return !masked || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)); };
+
+		std::error_code error;
+
+		for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", error))
+		{
+			const std::string name = entry.path().filename().string();
+			std::size_t id = 0;
+
+			if (!name.starts_with("node") || std::from_chars(name.data() + 4, name.data() + name.size(), id).ec != std::errc())
+				continue;
+
+			std::ifstream file(entry.path() / "cpulist");
+			std::string list;
+			std::getline(file, list);
+
+			Node node{ .id = id };
+
+			for (std::size_t cpu : parse_cpu_list(list))
+			{
+				if (usable(cpu))
+					node.cpus.push_back(cpu);
+			}
+
+			if (!node.cpus.empty())
+				topology.nodes.push_back(std::move(node));
+		}
+
+		if (topology.nodes.empty())
+		{
+			Node& node = topology.nodes.emplace_back();
+			const std::size_t count = masked ? CPU_SETSIZE : std::max(std::thread::hardware_concurrency(), 1u);
+
+			for (std::size_t cpu = 0; cpu < count; cpu++)
+			{
+				if (usable(cpu))
+					node.cpus.push_back(cpu);
+			}
+		}
+
+		std::sort(topology.nodes.begin(), topology.nodes.end(), [](const Node& a, const Node& b) { return a.id < b.id; });
+		return topology;
+	}
+
+	inline bool pin_thread(std::size_t cpu) noexcept
+	{
+		if (cpu >= CPU_SETSIZE)
+			return false;
+
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+	}
+
+	inline std::optional<std::size_t> current_cpu() noexcept
+	{
+		const int cpu = ::sched_getcpu();
+
+		if (cpu < 0)
+			return std::nullopt;
+
+		return static_cast<std::size_t>(cpu);
+	}
+
+	inline SavedAffinity::SavedAffinity() noexcept : saved_(::pthread_getaffinity_np(::pthread_self(), sizeof(affinity_), &affinity_) == 0) {}
+
+	inline SavedAffinity::~SavedAffinity() noexcept
+	{
+		if (saved_)
+			::pthread_setaffinity_np(::pthread_self(), sizeof(affinity_), &affinity_);
+	}
+#else
+	inline Topology Topology::detect()
+	{
+		Topology topology;
+		Node& node = topology.nodes.emplace_back();
+
+		for (std::size_t cpu = 0; cpu < std::max(std::thread::hardware_concurrency(), 1u); cpu++)
+			node.cpus.push_back(cpu);
+
+		return topology;
+	}
+
+	inline bool pin_thread(std::size_t) noexcept { return false; }
+
+	inline std::optional<std::size_t> current_cpu() noexcept { return std::nullopt; }
+
+	inline SavedAffinity::SavedAffinity() noexcept {}
+
+	inline SavedAffinity::~SavedAffinity() noexcept {}
+#endif
+}
@@ -6,11 +6,31 @@
 #include <mutex>
 #include <condition_variable>
 #include <cstdlib>
+#include <cstdint>
+#include <stdexcept>
 #include <iostream>
 #include <thread>
+#include <semaphore>
+#include <algorithm>
+#include <bit>
+#include <cstddef>
 #include <coroutine>
 #include <stdlib.h>
 #include <optional>
+#include <utility>
 #include <vector>
 #include <queue>
+#include <deque>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <new>
 #include <memory>
+#include <iterator>
+#include <chrono>
+#include <span>
+#include <tuple>
+#include <variant>
+#include <array>
+#include <ranges>
+#include <functional>
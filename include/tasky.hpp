@@ -2,9 +2,19 @@
 
 #include "pch.hpp"
 #include "lockfree/queue.hpp"
+#include "lockfree/deque.hpp"
+#include "lockfree/segmented_queue.hpp"
+#include "io/reactor.hpp"
+#include "timer/wheel.hpp"
+#include "numa/topology.hpp"
+#include "blocking/pool.hpp"
 
 #ifdef _WIN32
 #include <Windows.h>
+#elif defined(__linux__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #endif
 
 namespace tasky
@@ -15,599 +25,4940 @@ namespace tasky
 		static void free(void* ptr) { ::free(ptr); }
 	};
 
-	template<typename T, typename Allocator>
-	class Task;
+	/// Coroutine frame allocator, use as `Task<T, FramePool>`.
+	/// Frames are served from per-thread size-class free lists carved out of larger slabs.
+	/// A frame freed on another thread than the one that allocated it is collected in a
+	/// thread local batch and handed back to its owner once the batch is full (or the
+	/// owner changes), the owner picks the whole batch up with a single exchange.
+	/// Frames larger than the biggest size class go straight to malloc.
+	class FramePool
+	{
+	public:
+		[[nodiscard]] static void* alloc(std::size_t size)
+		{
+			const std::size_t total = size + sizeof(Header);
 
-	template<typename Allocator>
-	class Task<void, Allocator>;
+			if (total > max_block_size)
+			{
+				Header* header = static_cast<Header*>(::malloc(total));
 
-	class Scheduler;
+				if (header == nullptr)
+					throw std::bad_alloc();
 
-	struct PromiseBase
-	{
-		template<typename T>
-		constexpr static std::coroutine_handle<PromiseBase> cast(std::coroutine_handle<T> handle) noexcept { return std::coroutine_handle<PromiseBase>::from_address(handle.address()); }
+				header->owner = nullptr;
+				large_in_use_.fetch_add(1, std::memory_order::relaxed);
+				return header + 1;
+			}
 
-		constexpr std::suspend_always initial_suspend() const noexcept { return {}; }
-		constexpr std::suspend_always final_suspend() const noexcept { return {}; }
+			const std::size_t size_class = class_of(total);
+			Cache& cache = local_cache();
+			Header* header = cache.free[size_class];
 
-		void unhandled_exception()
-		{
-			exception = std::current_exception();
+			if (header == nullptr)
+			{
+				cache.drain_remote();
+				header = cache.free[size_class];
+
+				if (header == nullptr)
+					header = cache.refill(size_class);
+			}
+
+			cache.free[size_class] = next(header);
+			cache.allocated.store(cache.allocated.load(std::memory_order::relaxed) + 1, std::memory_order::relaxed);
+			return header + 1;
 		}
 
-		PromiseBase() {}
+		static void free(void* ptr)
+		{
+			if (ptr == nullptr)
+				return;
 
-		virtual ~PromiseBase() {}
+			Header* header = static_cast<Header*>(ptr) - 1;
 
-		std::atomic<std::size_t> awaiting_count = 0;
-		std::coroutine_handle<PromiseBase> awaiting_coro = nullptr;
-		std::exception_ptr exception = nullptr;
-		Scheduler* scheduler = nullptr;
-	};
+			if (header->owner == nullptr)
+			{
+				large_in_use_.fetch_sub(1, std::memory_order::relaxed);
+				::free(header);
+				return;
+			}
 
-	class Scheduler
-	{
-	public:
-		Scheduler(std::size_t workers = std::thread::hardware_concurrency() - 1) :
-			max_workers(workers),
-			queue_(1024)
-		{
-			std::cout << "Running scheduler with " << workers + 1 << " threads..." << std::endl;
-		}
+			ThreadState& state = state_;
 
-		template<typename T, typename Allocator>
-		void schedule(const std::vector<Task<T, Allocator>>& tasks)
-		{
-			running_tasks.fetch_add(tasks.size(), std::memory_order::acq_rel);
-			for (auto& t : tasks)
+			if (header->owner == state.cache)
 			{
-				std::coroutine_handle<PromiseBase> h = PromiseBase::cast(t.handle);
-				h.promise().scheduler = this;
-				queue_.push(h);
+				Cache& cache = *state.cache;
+				next(header) = cache.free[header->size_class];
+				cache.free[header->size_class] = header;
+				cache.freed.store(cache.freed.load(std::memory_order::relaxed) + 1, std::memory_order::relaxed);
+				return;
 			}
+
+			state.defer(header);
 		}
 
-		template<typename T>
-		void schedule(std::coroutine_handle<T> handle)
+		/// Number of frames currently handed out by all threads.
+		/// Best effort while other threads are allocating.
+		[[nodiscard]] static std::size_t in_use() noexcept
 		{
-			running_tasks.fetch_add(1, std::memory_order::acq_rel);
-			std::coroutine_handle<PromiseBase> h = PromiseBase::cast(handle);
-			h.promise().scheduler = this;
-			queue_.push(h);
+			std::scoped_lock lock(registry_mutex_);
+			std::size_t count = large_in_use_.load(std::memory_order::relaxed);
+
+			for (Cache* cache : caches_)
+			{
+				count += cache->allocated.load(std::memory_order::relaxed);
+				count -= cache->freed.load(std::memory_order::relaxed);
+				count -= cache->remote_freed.load(std::memory_order::relaxed);
+			}
+
+			for (ThreadState* state : batching_)
+				count -= state->batch_count.load(std::memory_order::relaxed);
+
+			return count;
 		}
 
-		template<typename T, typename Allocator>
-		void schedule(const Task<T, Allocator>& task)
+	private:
+		struct Cache;
+
+		/// Sits in front of every frame, keeps the frame 16 byte aligned.
+		struct alignas(16) Header
 		{
-			schedule(task.handle);
-		}
+			Cache* owner;
+			std::size_t size_class;
+		};
 
-		template<typename T, typename Allocator, typename... Ts>
-		void schedule(const Task<T, Allocator>& task, Ts... tasks)
+		static constexpr std::size_t min_block_shift = 6;
+		static constexpr std::size_t size_classes = 7;
+		static constexpr std::size_t max_block_size = std::size_t(1) << (min_block_shift + size_classes - 1);
+		static constexpr std::size_t slab_size = 64 * 1024;
+		static constexpr std::size_t batch_size = 32;
+
+		static constexpr std::size_t class_of(std::size_t total) noexcept
 		{
-			schedule(task.handle);
-			schedule(std::forward<Ts>(tasks)...);
+			const std::size_t width = static_cast<std::size_t>(std::bit_width(total - 1));
+			return width <= min_block_shift ? 0 : width - min_block_shift;
 		}
 
-		void run()
+		/// Slabs are fresh pages from the OS rather than recycled heap memory, so they land
+		/// on the NUMA node of the thread that carves them up. They are never returned.
+		[[nodiscard]] static std::byte* map_slab()
 		{
-			for (std::size_t i = 0; i < max_workers; i++)
-				workers_.emplace_back([&]() { run_worker(); });
+#ifdef _WIN32
+			void* slab = ::VirtualAlloc(nullptr, slab_size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
 
-			while (running_tasks.load(std::memory_order::acquire) > 0)
-				run_next_task();
+			if (slab == nullptr)
+				throw std::bad_alloc();
+#elif defined(__linux__)
+			void* slab = ::mmap(nullptr, slab_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 
-			for (auto& t : workers_)
-				t.join();
+			if (slab == MAP_FAILED)
+				throw std::bad_alloc();
+#else
+			void* slab = ::malloc(slab_size);
 
-			workers_.clear();
-		}
+			if (slab == nullptr)
+				throw std::bad_alloc();
+#endif
 
-		void schedule_awaiting(std::coroutine_handle<PromiseBase> handle)
-		{
-			queue_.push(handle);
+			return static_cast<std::byte*>(slab);
 		}
 
-	private:
-		void release_task() { running_tasks.fetch_sub(1, std::memory_order::acq_rel); }
+		/// Free blocks link through the first word of the frame, the header stays intact.
+		static Header*& next(Header* header) noexcept { return *reinterpret_cast<Header**>(header + 1); }
 
-		void run_worker()
+		struct alignas(lockfree::hardwareInterferenceSize) Cache
 		{
-			while (running_tasks.load(std::memory_order::acquire) > 1)
-				run_next_task();
-		}
+			Header* refill(std::size_t size_class)
+			{
+				const std::size_t block_size = std::size_t(1) << (size_class + min_block_shift);
+				std::byte* slab = map_slab();
+				slabs.push_back(slab);
 
-		void run_next_task()
-		{
-			auto handle = next_task();
+				for (std::size_t offset = 0; offset + block_size <= slab_size; offset += block_size)
+				{
+					Header* header = reinterpret_cast<Header*>(slab + offset);
+					header->owner = this;
+					header->size_class = size_class;
+					next(header) = free[size_class];
+					free[size_class] = header;
+				}
 
-			if (handle == nullptr)
-				return;
+				return free[size_class];
+			}
 
-			if (!handle.done())
+			void drain_remote() noexcept
 			{
-				handle.resume();
-				if (handle.done())
+				Header* header = remote.exchange(nullptr, std::memory_order::acquire);
+
+				while (header != nullptr)
 				{
-					release_task();
+					Header* following = next(header);
+					next(header) = free[header->size_class];
+					free[header->size_class] = header;
+					header = following;
+				}
+			}
 
-					auto awaiting = handle.promise().awaiting_coro;
+			// owner only
+			Header* free[size_classes] = {};
+			std::vector<std::byte*> slabs = {};
+			std::atomic<std::size_t> allocated = 0;
+			std::atomic<std::size_t> freed = 0;
 
-					if (awaiting != nullptr)
-					{
-						auto i = awaiting.promise().awaiting_count.fetch_sub(1, std::memory_order::acq_rel) - 1;
+			// other threads
+			alignas(lockfree::hardwareInterferenceSize) std::atomic<Header*> remote = nullptr;
+			std::atomic<std::size_t> remote_freed = 0;
+		};
 
-						if (i == 0)
-							schedule_awaiting(awaiting);
-					}
-					else if (handle.promise().exception)
-					{
-						std::rethrow_exception(handle.promise().exception);
-					}
-					else
-					{
-						handle.destroy();
-					}
+		struct ThreadState
+		{
+			~ThreadState()
+			{
+				flush();
+
+				std::scoped_lock lock(registry_mutex_);
+
+				if (registered)
+					std::erase(batching_, this);
+
+				// caches outlive their thread, frames may still be freed into them later
+				if (cache != nullptr)
+					orphans_.push_back(cache);
+			}
+
+			void defer(Header* header)
+			{
+				if (!registered)
+				{
+					std::scoped_lock lock(registry_mutex_);
+					batching_.push_back(this);
+					registered = true;
 				}
+
+				if (batch_owner != header->owner)
+					flush();
+
+				batch_owner = header->owner;
+				next(header) = batch_head;
+				batch_head = header;
+
+				if (batch_tail == nullptr)
+					batch_tail = header;
+
+				const std::size_t count = batch_count.load(std::memory_order::relaxed) + 1;
+				batch_count.store(count, std::memory_order::relaxed);
+
+				if (count == batch_size)
+					flush();
 			}
-			else
+
+			void flush() noexcept
 			{
-				release_task();
+				if (batch_head == nullptr)
+					return;
+
+				batch_owner->remote_freed.fetch_add(batch_count.load(std::memory_order::relaxed), std::memory_order::relaxed);
+
+				Header* head = batch_owner->remote.load(std::memory_order::relaxed);
+				do
+				{
+					next(batch_tail) = head;
+				} while (!batch_owner->remote.compare_exchange_weak(head, batch_head, std::memory_order::release, std::memory_order::relaxed));
+
+				batch_owner = nullptr;
+				batch_head = nullptr;
+				batch_tail = nullptr;
+				batch_count.store(0, std::memory_order::relaxed);
 			}
-		}
 
-		[[nodiscard]] std::coroutine_handle<PromiseBase> next_task()
+			Cache* cache = nullptr;
+			Cache* batch_owner = nullptr;
+			Header* batch_head = nullptr;
+			Header* batch_tail = nullptr;
+			std::atomic<std::size_t> batch_count = 0;
+			bool registered = false;
+		};
+
+		static Cache& local_cache()
 		{
-			if (queue_.size() == 0)
-				return nullptr;
+			ThreadState& state = state_;
 
-			std::coroutine_handle<PromiseBase> handle = nullptr;
-			queue_.try_pop(handle);
-			return handle;
+			if (state.cache != nullptr) [[likely]]
+				return *state.cache;
+
+			std::scoped_lock lock(registry_mutex_);
+
+			if (!orphans_.empty())
+			{
+				state.cache = orphans_.back();
+				orphans_.pop_back();
+			}
+			else
+			{
+				state.cache = new Cache();
+				caches_.push_back(state.cache);
+			}
+
+			return *state.cache;
 		}
 
-		std::atomic<std::size_t> running_tasks = 0;
-		const std::size_t max_workers;
-		lockfree::Queue<std::coroutine_handle<PromiseBase>> queue_;
-		std::vector<std::thread> workers_ = {};
+		static thread_local ThreadState state_;
+		static inline std::mutex registry_mutex_;
+		static inline std::vector<Cache*> caches_ = {};
+		static inline std::vector<Cache*> orphans_ = {};
+		static inline std::vector<ThreadState*> batching_ = {};
+		static inline std::atomic<std::size_t> large_in_use_ = 0;
 	};
 
-	template<typename T, typename Allocator = DefaultAllocator>
-	class Task
+	inline thread_local FramePool::ThreadState FramePool::state_;
+
+	/// Thrown from the suspension point of a task whose cancellation token fired.
+	class OperationCancelled : public std::runtime_error
 	{
 	public:
-		struct promise_type : public PromiseBase
+		OperationCancelled() : std::runtime_error("Operation cancelled!") {}
+	};
+
+	/// Intrusive callback, see CancellationToken::add(). Runs at most once, on the thread
+	/// that cancels.
+	struct CancellationCallback
+	{
+		using Function = void (*)(CancellationCallback& callback);
+
+		Function function = nullptr;
+
+		// owned by the token
+		CancellationCallback* prev = nullptr;
+		CancellationCallback* next = nullptr;
+		bool linked = false;
+	};
+
+	/// Shared by a CancellationSource and its tokens, the last one out deletes it.
+	/// A state created with a parent is cancelled together with it.
+	class CancellationState
+	{
+	public:
+		explicit CancellationState(CancellationState* parent = nullptr) : parent_(parent)
 		{
-			[[nodiscard]] static void* operator new(std::size_t size)
-			{
-				return Allocator::alloc(size);
-			}
+			if (parent_ == nullptr)
+				return;
 
-			static void operator delete(void* ptr)
-			{
-				Allocator::free(ptr);
-			}
+			parent_->acquire();
+			link_.state = this;
+			link_.function = onParentCancelled;
 
-			virtual ~promise_type() {}
+			if (!parent_->add(link_))
+				cancel();
+		}
 
-			[[nodiscard]] constexpr Task<T> get_return_object() noexcept { return Task<T>(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		~CancellationState()
+		{
+			if (parent_ == nullptr)
+				return;
 
-			constexpr void return_value(const T& val) noexcept
-			{
-				if (exception)
-					std::rethrow_exception(exception);
-				value.emplace(std::move(val));
-			}
+			parent_->remove(link_);
+			parent_->release();
+		}
 
-			constexpr void return_value(T&& val)
+		CancellationState(const CancellationState&) = delete;
+		CancellationState& operator=(const CancellationState&) = delete;
+
+		[[nodiscard]] bool cancelled() const noexcept { return cancelled_.load(std::memory_order::acquire); }
+
+		/// Runs every registered callback, only the first call does anything.
+		void cancel()
+		{
+			std::unique_lock lock(mutex_);
+
+			if (cancelled_.exchange(true, std::memory_order::acq_rel))
+				return;
+
+			runner_ = std::this_thread::get_id();
+
+			while (head_ != nullptr)
 			{
-				if (exception)
-					std::rethrow_exception(exception);
-				value.emplace(val);
+				CancellationCallback* callback = head_;
+				unlink(*callback);
+				running_ = callback;
+
+				lock.unlock();
+				callback->function(*callback);
+				lock.lock();
+
+				running_ = nullptr;
+				finished_.notify_all();
 			}
+		}
 
-			std::optional<T> value;
-		};
+		bool add(CancellationCallback& callback)
+		{
+			std::scoped_lock lock(mutex_);
 
-		using Handle = std::coroutine_handle<promise_type>;
+			if (cancelled_.load(std::memory_order::relaxed))
+				return false;
 
-		Task(Handle handle) : handle(handle) {}
-		Task(const Task& task) = delete;
-		Task(Task&& task) = delete;
-		~Task() {}
+			callback.prev = nullptr;
+			callback.next = head_;
+			callback.linked = true;
 
-		[[nodiscard]] auto operator co_await() const noexcept
+			if (head_ != nullptr)
+				head_->prev = &callback;
+
+			head_ = &callback;
+			return true;
+		}
+
+		/// Waits for the callback when another thread is running it.
+		bool remove(CancellationCallback& callback)
 		{
-			struct Awaiter
+			std::unique_lock lock(mutex_);
+
+			if (callback.linked)
 			{
-				constexpr bool await_ready() const noexcept { return false; }
+				unlink(callback);
+				return true;
+			}
 
-				[[nodiscard]] constexpr T await_resume() const
-				{
-					if (coro.promise().exception)
-						std::rethrow_exception(coro.promise().exception);
+			finished_.wait(lock, [&]() { return running_ != &callback || runner_ == std::this_thread::get_id(); });
+			return false;
+		}
 
-					return std::move(coro.promise().value.value());
-				}
+		void acquire() noexcept
+		{
+			refs_.fetch_add(1, std::memory_order::relaxed);
+		}
 
-				void await_suspend(std::coroutine_handle<> awaiting_handle)
-				{
-					auto handle = PromiseBase::cast(awaiting_handle);
-					auto& promise = handle.promise();
+		void release()
+		{
+			if (refs_.fetch_sub(1, std::memory_order::acq_rel) == 1)
+				delete this;
+		}
 
-					coro.promise().awaiting_coro = handle;
-					promise.awaiting_count.store(1, std::memory_order::release);
-					promise.scheduler->schedule(coro);
-				}
+	private:
+		struct Link : public CancellationCallback
+		{
+			CancellationState* state = nullptr;
+		};
 
-				std::coroutine_handle<promise_type> coro;
+		static void onParentCancelled(CancellationCallback& callback)
+		{
+			static_cast<Link&>(callback).state->cancel();
+		}
 
-				Awaiter(std::coroutine_handle<promise_type> coro) noexcept : coro(coro) {}
-				~Awaiter() { coro.destroy(); }
-			};
+		void unlink(CancellationCallback& callback) noexcept
+		{
+			if (callback.prev != nullptr)
+				callback.prev->next = callback.next;
+			else
+				head_ = callback.next;
 
-			return Awaiter(handle);
+			if (callback.next != nullptr)
+				callback.next->prev = callback.prev;
+
+			callback.prev = nullptr;
+			callback.next = nullptr;
+			callback.linked = false;
 		}
 
-		Handle handle;
+		std::atomic<bool> cancelled_ = false;
+		std::atomic<std::size_t> refs_ = 1;
+		std::mutex mutex_;
+		std::condition_variable finished_;
+		CancellationCallback* head_ = nullptr;
+		CancellationCallback* running_ = nullptr;
+		std::thread::id runner_ = {};
+		CancellationState* const parent_;
+		Link link_ = {};
 	};
 
-	template<typename Allocator>
-	class Task<void, Allocator>
+	/// Observes a CancellationSource. Tasks inherit the token of the task that awaits
+	/// them, see with_cancellation(). An empty token is never cancelled and costs nothing.
+	class CancellationToken
 	{
 	public:
-		struct promise_type : public PromiseBase
+		CancellationToken() noexcept = default;
+
+		CancellationToken(const CancellationToken& other) noexcept : state_(other.state_)
 		{
-			[[nodiscard]] static void* operator new(std::size_t size)
-			{
-				return Allocator::alloc(size);
-			}
+			if (state_ != nullptr)
+				state_->acquire();
+		}
 
-			static void operator delete(void* ptr)
-			{
-				Allocator::free(ptr);
-			}
+		CancellationToken(CancellationToken&& other) noexcept : state_(std::exchange(other.state_, nullptr)) {}
 
-			virtual ~promise_type() {}
+		CancellationToken& operator=(CancellationToken other) noexcept
+		{
+			std::swap(state_, other.state_);
+			return *this;
+		}
 
-			[[nodiscard]] Task<void> get_return_object() noexcept { return Task<void>(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		~CancellationToken()
+		{
+			if (state_ != nullptr)
+				state_->release();
+		}
 
-			constexpr void return_void() const
-			{
-				if (exception)
-					std::rethrow_exception(exception);
-			}
-		};
+		/// False for an empty token.
+		[[nodiscard]] explicit operator bool() const noexcept { return state_ != nullptr; }
 
-		using Handle = std::coroutine_handle<promise_type>;
+		[[nodiscard]] bool cancelled() const noexcept { return state_ != nullptr && state_->cancelled(); }
 
-		Task(Handle handle) : handle(handle) {}
-		Task(const Task& task) = delete;
-		Task(Task&& task) = delete;
-		~Task() {}
+		/// Registers a callback for when the token is cancelled. False when that already
+		/// happened, the callback is not registered then. The callback has to stay alive
+		/// until it ran or remove() returned.
+		bool add(CancellationCallback& callback) const
+		{
+			return state_ == nullptr || state_->add(callback);
+		}
 
-		[[nodiscard]] auto operator co_await() noexcept
+		/// False when the callback is not registered, e.g. because it already ran. If it is
+		/// running on another thread this waits for it to finish.
+		bool remove(CancellationCallback& callback) const
 		{
-			struct Awaiter
-			{
-				constexpr bool await_ready() const noexcept { return false; }
+			return state_ != nullptr && state_->remove(callback);
+		}
+
+	private:
+		friend class CancellationSource;
+
+		explicit CancellationToken(CancellationState* state) noexcept : state_(state)
+		{
+			if (state_ != nullptr)
+				state_->acquire();
+		}
+
+		CancellationState* state_ = nullptr;
+	};
+
+	/// Cancels the tasks that hold one of its tokens. A source made from a parent token is
+	/// cancelled along with the parent.
+	class CancellationSource
+	{
+	public:
+		CancellationSource() : state_(new CancellationState()) {}
+
+		explicit CancellationSource(const CancellationToken& parent) : state_(new CancellationState(parent.state_)) {}
+
+		CancellationSource(const CancellationSource&) = delete;
+		CancellationSource& operator=(const CancellationSource&) = delete;
+
+		~CancellationSource()
+		{
+			state_->release();
+		}
+
+		[[nodiscard]] CancellationToken token() const noexcept { return CancellationToken(state_); }
+
+		[[nodiscard]] bool cancelled() const noexcept { return state_->cancelled(); }
+
+		/// Runs the callbacks registered with the tokens on this thread, e.g. to cancel
+		/// their I/O. Running tasks notice the next time they suspend.
+		void cancel() { state_->cancel(); }
+
+	private:
+		CancellationState* const state_;
+	};
+
+	template<typename T, typename Allocator>
+	class Task;
+
+	template<typename Allocator>
+	class Task<void, Allocator>;
+
+	class Scheduler;
+
+	/// Scheduling class of a task. Every class has its own run queues, workers pick
+	/// between them by weighted round-robin so high priority tasks get ahead of a
+	/// backlog without starving the lower classes. Awaited tasks run with the priority
+	/// of the task awaiting them.
+	enum class Priority : std::uint8_t
+	{
+		high,
+		normal,
+		low,
+	};
+
+	inline constexpr std::size_t priority_count = 3;
+
+	struct PromiseBase
+	{
+		template<typename T>
+		constexpr static std::coroutine_handle<PromiseBase> cast(std::coroutine_handle<T> handle) noexcept { return std::coroutine_handle<PromiseBase>::from_address(handle.address()); }
+
+		constexpr std::suspend_always initial_suspend() const noexcept { return {}; }
+
+		/// Hands the thread straight to the awaiting coroutine once the last task it waits
+		/// for is done (symmetric transfer), root tasks are handed back to the scheduler.
+		struct FinalAwaiter
+		{
+			constexpr bool await_ready() const noexcept { return false; }
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<> handle) const noexcept;
+			constexpr void await_resume() const noexcept {}
+		};
+
+		constexpr FinalAwaiter final_suspend() const noexcept { return {}; }
+
+		void unhandled_exception()
+		{
+			exception = std::current_exception();
+		}
+
+		/// Hands our priority to a task we are about to start, and our token unless it
+		/// has one of its own.
+		void inherit(PromiseBase& child) const noexcept
+		{
+			child.priority = priority;
+
+			if (cancellation && !child.cancellation)
+				child.cancellation = cancellation;
+		}
+
+		/// The continuation and the number of tasks it still waits for, see FinalAwaiter.
+		std::coroutine_handle<PromiseBase> awaiting_coro = nullptr;
+		std::atomic<std::uint32_t> awaiting_count = 0;
+		Priority priority = Priority::normal;
+		CancellationToken cancellation = {};
+		std::exception_ptr exception = nullptr;
+	};
+
+	// lives in every frame: no vtable, no scheduler pointer (see Scheduler::current()),
+	// and the counter and priority share a word
+	static_assert(sizeof(PromiseBase) <= 2 * sizeof(void*) + sizeof(CancellationToken) + sizeof(std::exception_ptr));
+
+	/// Counters of one worker, see Scheduler::stats().
+	struct WorkerStats
+	{
+		/// Coroutines the worker resumed from its deque, the shared queue or a steal.
+		std::uint64_t tasks_run = 0;
+		/// Of those, tasks taken from the worker's next slot, i.e. a continuation or a
+		/// task it scheduled itself just before.
+		std::uint64_t next_runs = 0;
+		/// Root tasks that finished on this worker.
+		std::uint64_t tasks_finished = 0;
+		/// Tasks taken from another worker's deque.
+		std::uint64_t steals = 0;
+		/// Steals, and batches taken off the shared queues, from another NUMA node.
+		std::uint64_t remote_steals = 0;
+		/// Times the worker looked for a task and found none.
+		std::uint64_t empty_polls = 0;
+		std::uint64_t parks = 0;
+		std::uint64_t io_completions = 0;
+		std::uint64_t timers_fired = 0;
+		/// Time spent yielding between empty polls before parking.
+		std::chrono::nanoseconds spin_time = {};
+		/// Time spent parked, including waiting in the reactor.
+		std::chrono::nanoseconds idle_time = {};
+		/// Tasks waiting in the worker's deques when the snapshot was taken.
+		std::size_t deque_size = 0;
+		/// Index of the worker's NUMA node, always 0 unless the workers are pinned.
+		std::size_t node = 0;
+	};
+
+	/// Snapshot of the scheduler taken by Scheduler::stats(). The counters add up from
+	/// the construction of the scheduler, and while run() is active each one is read on
+	/// its own, so they need not be consistent with each other.
+	struct SchedulerStats
+	{
+		std::vector<WorkerStats> workers;
+		/// Tasks waiting in the shared submission queues.
+		std::size_t queue_size = 0;
+		std::size_t running_tasks = 0;
+		std::size_t idle_workers = 0;
+		/// Workers allowed to take tasks, see Scheduler::set_active_workers().
+		std::size_t active_workers = 0;
+		/// Threads of the blocking pool, see offload().
+		std::size_t blocking_threads = 0;
+		std::size_t timers = 0;
+
+		/// All workers added up.
+		[[nodiscard]] WorkerStats total() const noexcept
+		{
+			WorkerStats sum;
+
+			for (const WorkerStats& w : workers)
+			{
+				sum.tasks_run += w.tasks_run;
+				sum.next_runs += w.next_runs;
+				sum.tasks_finished += w.tasks_finished;
+				sum.steals += w.steals;
+				sum.remote_steals += w.remote_steals;
+				sum.empty_polls += w.empty_polls;
+				sum.parks += w.parks;
+				sum.io_completions += w.io_completions;
+				sum.timers_fired += w.timers_fired;
+				sum.spin_time += w.spin_time;
+				sum.idle_time += w.idle_time;
+				sum.deque_size += w.deque_size;
+			}
+
+			return sum;
+		}
+	};
+
+	/// Where the scheduler runs its workers.
+	enum class Placement : std::uint8_t
+	{
+		/// Wherever the OS puts them.
+		any,
+		/// Every worker pinned to a CPU of its own, spread evenly over the NUMA nodes.
+		/// Workers of a node share its submission queues and steal from each other
+		/// before they go to another node.
+		pinned,
+	};
+
+	class Scheduler
+	{
+	public:
+		/// `queue_capacity` is the initial size of each priority's queue for submissions
+		/// from outside the pool, it grows when a burst does not fit.
+		Scheduler(std::size_t workers = std::thread::hardware_concurrency() - 1, std::size_t queue_capacity = 1024, Placement placement = Placement::any) :
+			max_workers(workers)
+		{
+			place(placement, queue_capacity);
+			active_workers_.store(workers_.size(), std::memory_order::relaxed);
+
+			std::cout << "Running scheduler with " << workers + 1 << " threads";
+
+			if (nodes_.size() > 1)
+				std::cout << " on " << nodes_.size() << " NUMA nodes";
+
+			std::cout << "..." << std::endl;
+		}
+
+		template<typename T, typename Allocator>
+		void schedule(const std::vector<Task<T, Allocator>>& tasks, Priority priority = Priority::normal)
+		{
+			std::vector<std::coroutine_handle<PromiseBase>> handles;
+			handles.reserve(tasks.size());
+
+			for (auto& t : tasks)
+			{
+				std::coroutine_handle<PromiseBase> h = PromiseBase::cast(t.handle);
+				h.promise().priority = priority;
+				handles.push_back(h);
+			}
+
+			running_tasks.fetch_add(tasks.size(), std::memory_order::acq_rel);
+			push_n(handles);
+			wake(tasks.size());
+		}
+
+		template<typename T>
+		void schedule(std::coroutine_handle<T> handle, Priority priority = Priority::normal)
+		{
+			running_tasks.fetch_add(1, std::memory_order::acq_rel);
+			std::coroutine_handle<PromiseBase> h = PromiseBase::cast(handle);
+			h.promise().priority = priority;
+
+			// the caller usually keeps running, a high priority task should not wait for
+			// it in the next slot
+			if (push(h, priority != Priority::high))
+				wake(1);
+		}
+
+		template<typename T, typename Allocator>
+		void schedule(const Task<T, Allocator>& task, Priority priority = Priority::normal)
+		{
+			schedule(task.handle, priority);
+		}
+
+		template<typename T, typename Allocator, typename... Ts>
+		void schedule(const Task<T, Allocator>& task, Ts... tasks)
+		{
+			schedule(task.handle);
+			schedule(std::forward<Ts>(tasks)...);
+		}
+
+		void run()
+		{
+			// the calling thread is worker 0, it gets its own affinity back afterwards
+			std::optional<numa::SavedAffinity> affinity;
+
+			if (workers_[0]->cpu != any_cpu)
+				affinity.emplace();
+
+			for (std::size_t i = 0; i < max_workers; i++)
+				threads_.emplace_back([this, i]() { run_worker(*workers_[i + 1]); });
+
+			run_worker(*workers_[0]);
+
+			for (auto& t : threads_)
+				t.join();
+
+			threads_.clear();
+
+			if (exception_)
+				std::rethrow_exception(std::exchange(exception_, nullptr));
+		}
+
+		/// Queues a coroutine that belongs to an already scheduled task, e.g. a suspended
+		/// parent or the children of all(). Unlike schedule() it does not add a root task,
+		/// and the coroutine keeps the priority it has.
+		void schedule_awaiting(std::coroutine_handle<PromiseBase> handle)
+		{
+			if (push(handle))
+				wake(1);
+		}
+
+		/// Same as above for many coroutines of the same priority, they are queued as one
+		/// batch.
+		void schedule_awaiting(std::span<const std::coroutine_handle<PromiseBase>> handles)
+		{
+			push_n(handles);
+			wake(handles.size());
+		}
+
+#ifdef __linux__
+		/// Starts an I/O request, its callback runs on whichever worker polls the reactor.
+		/// Requests from a worker are batched and go out when it flushes, see run_worker().
+		/// If no worker is waiting in the reactor yet an idle one is woken to take over.
+		void submit(io::Request& request)
+		{
+			reactor_.submit(request);
+
+			if (local_worker() == nullptr)
+				reactor_.flush();
+
+			if (!poller_.load(std::memory_order::relaxed))
+				wake(1);
+		}
+
+		[[nodiscard]] io::Reactor& reactor() noexcept { return reactor_; }
+#endif
+
+		/// Threads in the pool, including the one calling run().
+		[[nodiscard]] std::size_t worker_count() const noexcept { return workers_.size(); }
+
+		/// Lets only the first `count` workers take tasks, between 1 (the thread calling
+		/// run()) and worker_count(). The others finish the task they are running, hand
+		/// their next slot over and rest until the limit is raised again or run() returns,
+		/// what is left in their deques gets stolen. Can be called from any thread, also
+		/// while run() is active.
+		void set_active_workers(std::size_t count)
+		{
+			active_workers_.store(std::clamp<std::size_t>(count, 1, workers_.size()), std::memory_order::relaxed);
+
+			// a resting worker checks the limit with the lock held
+			{
+				std::scoped_lock lock(rest_mutex_);
+			}
+
+			rest_cv_.notify_all();
+		}
+
+		[[nodiscard]] std::size_t active_workers() const noexcept { return active_workers_.load(std::memory_order::relaxed); }
+
+		/// Threads for blocking calls, see offload().
+		[[nodiscard]] blocking::Pool& blocking_pool() noexcept { return blocking_; }
+
+		/// The scheduler running the calling thread, nullptr outside of its workers. Tasks
+		/// only ever run on workers, so promises need not carry a pointer of their own.
+		[[nodiscard]] static Scheduler* current() noexcept
+		{
+			return current_worker_ != nullptr ? current_worker_->scheduler : nullptr;
+		}
+
+		/// Runs the timer's callback on a worker once `deadline` has passed, with millisecond
+		/// resolution. The timer has to stay alive until then or until cancel_timer()
+		/// succeeds. It goes into the wheel of the calling worker, so workers arming
+		/// timers at the same time do not contend.
+		void add_timer(timer::Timer& timer, std::chrono::steady_clock::time_point deadline)
+		{
+			Worker& owner = timer_worker();
+			timer.deadline = to_tick(deadline);
+			timer.wheel = static_cast<std::uint32_t>(owner.index);
+			std::uint64_t next = 0;
+			{
+				std::scoped_lock lock(owner.timer_mutex);
+
+				// an empty wheel lags behind, catching up keeps the new timer on a low level
+				if (owner.timers.empty())
+					(void)owner.timers.advance(now_tick());
+
+				owner.timers.insert(timer);
+				next = owner.timers.next_deadline();
+				owner.next_deadline.store(next, std::memory_order::seq_cst);
+			}
+
+			if (lower_next_deadline(next))
+				wake_timekeeper();
+		}
+
+		/// False when the callback already ran or is about to.
+		bool cancel_timer(timer::Timer& timer)
+		{
+			Worker& owner = *workers_[timer.wheel];
+			bool cancelled = false;
+			bool empty = false;
+			{
+				std::scoped_lock lock(owner.timer_mutex);
+				cancelled = owner.timers.cancel(timer);
+				empty = owner.timers.empty();
+				owner.next_deadline.store(owner.timers.next_deadline(), std::memory_order::seq_cst);
+			}
+
+			// an earlier deadline left behind only wakes the timekeeper once for nothing,
+			// but with the last timer gone it should not keep time at all
+			if (empty)
+				refresh_next_deadline();
+
+			return cancelled;
+		}
+
+		/// Can be called from any thread, also while run() is active.
+		[[nodiscard]] SchedulerStats stats() const
+		{
+			SchedulerStats stats;
+			stats.workers.reserve(workers_.size());
+
+			for (const auto& worker : workers_)
+			{
+				const Counters& c = worker->counters;
+				WorkerStats& w = stats.workers.emplace_back();
+				w.tasks_run = c.tasks_run.load(std::memory_order::relaxed);
+				w.next_runs = c.next_runs.load(std::memory_order::relaxed);
+				w.tasks_finished = c.tasks_finished.load(std::memory_order::relaxed);
+				w.steals = c.steals.load(std::memory_order::relaxed);
+				w.remote_steals = c.remote_steals.load(std::memory_order::relaxed);
+				w.empty_polls = c.empty_polls.load(std::memory_order::relaxed);
+				w.parks = c.parks.load(std::memory_order::relaxed);
+				w.io_completions = c.io_completions.load(std::memory_order::relaxed);
+				w.timers_fired = c.timers_fired.load(std::memory_order::relaxed);
+				w.spin_time = std::chrono::nanoseconds(c.spin_ns.load(std::memory_order::relaxed));
+				w.idle_time = std::chrono::nanoseconds(c.idle_ns.load(std::memory_order::relaxed));
+
+				for (const auto& deque : worker->deques)
+					w.deque_size += static_cast<std::size_t>(std::max<std::ptrdiff_t>(deque.size(), 0));
+
+				w.node = worker->node;
+			}
+
+			stats.queue_size = queue_size();
+			stats.running_tasks = running_tasks.load(std::memory_order::relaxed);
+			stats.idle_workers = idle_count_.load(std::memory_order::relaxed);
+			stats.active_workers = active_workers_.load(std::memory_order::relaxed);
+			stats.blocking_threads = blocking_.thread_count();
+
+			for (const auto& worker : workers_)
+			{
+				std::scoped_lock lock(worker->timer_mutex);
+				stats.timers += worker->timers.size();
+			}
+
+			return stats;
+		}
+
+		/// Current capacity of the shared submission queues, all priorities and nodes added up.
+		[[nodiscard]] std::size_t queue_capacity() const noexcept
+		{
+			std::size_t capacity = 0;
+
+			for (const auto& node : nodes_)
+			{
+				for (const auto& queue : node->queues)
+					capacity += queue.capacity();
+			}
+
+			return capacity;
+		}
+
+		/// Number of tasks waiting in the shared submission queues, a best effort guess while running.
+		[[nodiscard]] std::size_t queue_size() const noexcept
+		{
+			std::size_t size = 0;
+
+			for (const auto& node : nodes_)
+			{
+				for (const auto& queue : node->queues)
+					size += static_cast<std::size_t>(std::max<std::ptrdiff_t>(queue.size(), 0));
+			}
+
+			return size;
+		}
+
+		/// Number of NUMA nodes the workers are spread over, 1 unless they are pinned.
+		[[nodiscard]] std::size_t node_count() const noexcept { return nodes_.size(); }
+
+	private:
+		friend struct PromiseBase;
+
+		template<typename Body>
+		friend class ParallelAwaiter;
+
+		friend class FileReader;
+
+		/// Like schedule(), but never into the next slot: the calling worker keeps going,
+		/// the task is meant for whoever is idle.
+		template<typename T>
+		void fork(std::coroutine_handle<T> handle, Priority priority)
+		{
+			running_tasks.fetch_add(1, std::memory_order::acq_rel);
+			std::coroutine_handle<PromiseBase> h = PromiseBase::cast(handle);
+			h.promise().priority = priority;
+			push(h, false);
+			wake(1);
+		}
+
+		/// Splitting work off only pays while somebody can take it: a parked worker,
+		/// which fork() wakes and so takes off the count, or a busy one running dry once
+		/// the calling worker has nothing queued at this priority for it to steal.
+		[[nodiscard]] bool should_split(Priority priority) const noexcept
+		{
+			const Worker* worker = local_worker();
+
+			if (worker == nullptr || active_workers_.load(std::memory_order::relaxed) < 2)
+				return false;
+
+			return idle_count_.load(std::memory_order::relaxed) > 0 || worker->deques[static_cast<std::size_t>(priority)].empty();
+		}
+
+		/// Only written by the worker's own thread, so a plain load and store is enough
+		/// and stats() can read them at any time.
+		struct Counters
+		{
+			static void add(std::atomic<std::uint64_t>& counter, std::uint64_t n = 1) noexcept
+			{
+				counter.store(counter.load(std::memory_order::relaxed) + n, std::memory_order::relaxed);
+			}
+
+			std::atomic<std::uint64_t> tasks_run = 0;
+			std::atomic<std::uint64_t> next_runs = 0;
+			std::atomic<std::uint64_t> tasks_finished = 0;
+			std::atomic<std::uint64_t> steals = 0;
+			std::atomic<std::uint64_t> remote_steals = 0;
+			std::atomic<std::uint64_t> empty_polls = 0;
+			std::atomic<std::uint64_t> parks = 0;
+			std::atomic<std::uint64_t> io_completions = 0;
+			std::atomic<std::uint64_t> timers_fired = 0;
+			std::atomic<std::uint64_t> spin_ns = 0;
+			std::atomic<std::uint64_t> idle_ns = 0;
+		};
+
+		using Queue = lockfree::SegmentedQueue<std::coroutine_handle<PromiseBase>>;
+		using Deque = lockfree::WorkStealingDeque<std::coroutine_handle<PromiseBase>>;
+
+		/// Per thread state. A task scheduled from a worker goes into its next slot, the
+		/// task that was there moves onto the worker's deque for its priority, and idle
+		/// workers steal from the deques of the others. Only submissions from threads
+		/// outside the pool go through the shared queues. Aligned so neighbouring workers
+		/// never share a cache line, the counters and the timers start lines of their own.
+		struct alignas(lockfree::hardwareInterferenceSize) Worker
+		{
+			Worker(Scheduler* scheduler, std::size_t index, std::size_t node, std::size_t cpu) :
+				scheduler(scheduler), index(index), node(node), cpu(cpu), seed(index * 0x9E3779B97F4A7C15ull + 1) {}
+
+			Scheduler* const scheduler;
+			const std::size_t index;
+			/// Index into nodes_.
+			const std::size_t node;
+			/// The CPU the worker is pinned to, or any_cpu.
+			const std::size_t cpu;
+			std::uint64_t seed;
+			/// Position in lane_cycle.
+			std::size_t turn = 0;
+			/// The task to run next, whatever else is queued. Only the worker itself
+			/// touches it, so it stays on the core whose cache holds its frame.
+			std::coroutine_handle<PromiseBase> next = nullptr;
+			/// Tasks in a row taken from `next`.
+			std::size_t next_runs = 0;
+			std::array<Deque, priority_count> deques;
+			std::counting_semaphore<> wakeup{ 0 };
+			/// Written after every task, away from the fields thieves and wakers touch.
+			alignas(lockfree::hardwareInterferenceSize) Counters counters;
+			/// Timers added on this worker, see add_timer(). Others only take the lock to
+			/// expire or cancel them.
+			alignas(lockfree::hardwareInterferenceSize) std::mutex timer_mutex;
+			timer::Wheel timers;
+			/// Tick of the earliest timer in `timers`, written with timer_mutex held.
+			std::atomic<std::uint64_t> next_deadline = timer::Wheel::never;
+		};
+
+		/// Workers sharing a NUMA node, with the queues for submissions made on it. There
+		/// is a single node holding every worker unless they are pinned.
+		struct Node
+		{
+			explicit Node(std::size_t queue_capacity) : queues{ Queue(queue_capacity), Queue(queue_capacity), Queue(queue_capacity) } {}
+
+			std::array<Queue, priority_count> queues;
+			std::vector<Worker*> workers = {};
+		};
+
+		static constexpr std::size_t any_cpu = std::numeric_limits<std::size_t>::max();
+		static constexpr std::size_t no_node = std::numeric_limits<std::size_t>::max();
+
+		/// Rounds of failed polling before a worker parks.
+		static constexpr std::size_t spin_limit = 64;
+
+		/// Tasks a worker takes from its next slot in a row before it looks at its queues
+		/// again, so two tasks waking each other up cannot starve everything else.
+		static constexpr std::size_t next_limit = 3;
+
+		/// Tasks a worker takes from the shared queue at once.
+		static constexpr std::size_t queue_batch = 16;
+
+		/// Tasks a busy worker runs before it hands the I/O they started to the reactor.
+		static constexpr std::size_t flush_interval = 64;
+
+		/// Which priority a worker looks at first for each task it picks, weighted 8:4:1.
+		/// The other priorities follow in order, so a worker never idles while there is
+		/// work, and a low priority backlog still gets at least one pick in 13.
+		static constexpr std::array<Priority, 13> lane_cycle = {
+			Priority::high, Priority::normal, Priority::high, Priority::high, Priority::normal, Priority::high, Priority::low,
+			Priority::high, Priority::normal, Priority::high, Priority::high, Priority::normal, Priority::high,
+		};
+
+		[[nodiscard]] static std::size_t lane_of(std::coroutine_handle<PromiseBase> handle) noexcept
+		{
+			return static_cast<std::size_t>(handle.promise().priority);
+		}
+
+		static inline thread_local Worker* current_worker_ = nullptr;
+
+		[[nodiscard]] Worker* local_worker() const noexcept
+		{
+			return current_worker_ != nullptr && current_worker_->scheduler == this ? current_worker_ : nullptr;
+		}
+
+		/// Creates the workers. With Placement::pinned they take the CPUs of the nodes in
+		/// turn, so they spread evenly and only double up when there are more workers
+		/// than CPUs. Only nodes that got a worker get queues.
+		void place(Placement placement, std::size_t queue_capacity)
+		{
+			const std::size_t count = max_workers + 1;
+			std::vector<std::pair<std::size_t, std::size_t>> slots;
+			numa::Topology topology;
+
+			if (placement == Placement::pinned)
+			{
+				topology = numa::Topology::detect();
+
+				for (std::size_t i = 0; slots.size() < topology.cpu_count(); i++)
+				{
+					for (std::size_t n = 0; n < topology.nodes.size(); n++)
+					{
+						if (i < topology.nodes[n].cpus.size())
+							slots.emplace_back(n, topology.nodes[n].cpus[i]);
+					}
+				}
+			}
+
+			if (slots.empty())
+				slots.emplace_back(0, any_cpu);
+
+			std::vector<std::size_t> index(std::max<std::size_t>(topology.nodes.size(), 1), no_node);
+
+			for (std::size_t i = 0; i < count; i++)
+			{
+				const auto [topology_node, cpu] = slots[i % slots.size()];
+				std::size_t& node = index[topology_node];
+
+				if (node == no_node)
+				{
+					node = nodes_.size();
+					nodes_.push_back(std::make_unique<Node>(queue_capacity));
+				}
+
+				// slot 0 belongs to the thread calling run()
+				workers_.emplace_back(std::make_unique<Worker>(this, i, node, cpu));
+				nodes_[node]->workers.push_back(workers_.back().get());
+			}
+
+			if (nodes_.size() < 2)
+				return;
+
+			for (std::size_t n = 0; n < topology.nodes.size(); n++)
+			{
+				if (index[n] == no_node)
+					continue;
+
+				for (std::size_t cpu : topology.nodes[n].cpus)
+				{
+					if (cpu >= cpu_nodes_.size())
+						cpu_nodes_.resize(cpu + 1, no_node);
+
+					cpu_nodes_[cpu] = index[n];
+				}
+			}
+		}
+
+		/// Submissions from outside the pool go to the node of the CPU they are made on,
+		/// or to the nodes in turn when that one has no workers.
+		[[nodiscard]] Node& submission_node() noexcept
+		{
+			if (nodes_.size() == 1)
+				return *nodes_[0];
+
+			if (const auto cpu = numa::current_cpu(); cpu && *cpu < cpu_nodes_.size() && cpu_nodes_[*cpu] != no_node)
+				return *nodes_[cpu_nodes_[*cpu]];
+
+			return *nodes_[next_node_.fetch_add(1, std::memory_order::relaxed) % nodes_.size()];
+		}
+
+		/// From a worker the newest task goes into its next slot, a task it pushes out
+		/// onto the deque. False when the task stays in the slot, where no other worker
+		/// can take it, so there is nobody to wake.
+		bool push(std::coroutine_handle<PromiseBase> handle, bool use_slot = true)
+		{
+			if (Worker* worker = local_worker())
+			{
+				if (use_slot)
+					handle = std::exchange(worker->next, handle);
+
+				if (handle == nullptr)
+					return false;
+
+				worker->deques[lane_of(handle)].push(handle);
+			}
+			else
+			{
+				submission_node().queues[lane_of(handle)].push(handle);
+			}
+
+			return true;
+		}
+
+		/// The handles share one priority.
+		void push_n(std::span<const std::coroutine_handle<PromiseBase>> handles)
+		{
+			if (handles.empty())
+				return;
+
+			const std::size_t lane = lane_of(handles.front());
+
+			if (Worker* worker = local_worker())
+				worker->deques[lane].push_n(handles.data(), handles.size());
+			else
+				submission_node().queues[lane].push_n(handles.begin(), handles.size());
+		}
+
+		/// Counts something that is no task as one, so run() does not return before it
+		/// is done. Paired with release_task().
+		void retain_task() noexcept
+		{
+			running_tasks.fetch_add(1, std::memory_order::acq_rel);
+		}
+
+		void release_task()
+		{
+			// the last task is gone, every parked or resting worker has to wake up to
+			// leave run()
+			if (running_tasks.fetch_sub(1, std::memory_order::acq_rel) == 1)
+			{
+				wake(workers_.size());
+
+				{
+					std::scoped_lock lock(rest_mutex_);
+				}
+
+				rest_cv_.notify_all();
+			}
+		}
+
+		void run_worker(Worker& worker)
+		{
+			if (worker.cpu != any_cpu)
+				(void)numa::pin_thread(worker.cpu);
+
+			current_worker_ = &worker;
+			std::size_t idle_rounds = 0;
+			std::size_t unflushed = 0;
+			Counters& counters = worker.counters;
+			std::chrono::steady_clock::time_point spin_start = {};
+
+			while (running_tasks.load(std::memory_order::acquire) > 0)
+			{
+				if (worker.index >= active_workers_.load(std::memory_order::relaxed))
+				{
+					rest(worker);
+					continue;
+				}
+
+				bool ran = run_next_task();
+
+				// I/O started by the tasks goes out in one batch once the worker runs dry,
+				// or every flush_interval tasks so a busy worker does not hold it back;
+				// due timers are checked at the same points
+				if (!ran || ++unflushed == flush_interval)
+				{
+					unflushed = 0;
+					flush_io();
+					ran = expire_timers() || ran;
+				}
+
+				if (ran || poll_io())
+				{
+					if (idle_rounds > 0)
+						Counters::add(counters.spin_ns, elapsed_ns(spin_start));
+
+					idle_rounds = 0;
+					continue;
+				}
+
+				Counters::add(counters.empty_polls);
+
+				if (idle_rounds++ == 0)
+					spin_start = std::chrono::steady_clock::now();
+
+				if (idle_rounds < spin_limit)
+				{
+					std::this_thread::yield();
+				}
+				else
+				{
+					const auto park_start = std::chrono::steady_clock::now();
+					Counters::add(counters.spin_ns, elapsed_ns(spin_start, park_start));
+					Counters::add(counters.parks);
+
+					idle_rounds = 0;
+					park(worker);
+
+					Counters::add(counters.idle_ns, elapsed_ns(park_start));
+				}
+			}
+
+			current_worker_ = nullptr;
+		}
+
+		[[nodiscard]] static std::uint64_t elapsed_ns(std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now()) noexcept
+		{
+			return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+		}
+
+		/// Puts the worker to sleep until wake() hands it new work. The worker announces
+		/// itself as idle before checking for work one last time, and wake() publishes the
+		/// work before looking for idle workers, so one of the two always sees the other.
+		/// While timers are armed one parked worker keeps time and only sleeps until the
+		/// next deadline, add_timer() and the timekeeper use the same handshake.
+		void park(Worker& worker)
+		{
+#ifdef __linux__
+			// while I/O is in flight one idle worker waits in the reactor instead, so
+			// completions get delivered; wake() knocks it out when there is new work
+			if (reactor_.pending() > 0 && !poller_.exchange(true, std::memory_order::seq_cst))
+			{
+				std::atomic_thread_fence(std::memory_order::seq_cst);
+
+				if (!has_work() && running_tasks.load(std::memory_order::acquire) > 0)
+					Counters::add(worker.counters.io_completions, reactor_.poll(true, from_tick(next_deadline_.load(std::memory_order::relaxed))));
+
+				poller_.store(false, std::memory_order::release);
+				return;
+			}
+#endif
+
+			Worker* keeper = nullptr;
+			const bool keeps_time = next_deadline_.load(std::memory_order::relaxed) != timer::Wheel::never &&
+				timekeeper_.compare_exchange_strong(keeper, &worker, std::memory_order::seq_cst);
+
+			{
+				std::scoped_lock lock(idle_mutex_);
+				idle_.push_back(&worker);
+				idle_count_.fetch_add(1, std::memory_order::seq_cst);
+			}
+
+			std::atomic_thread_fence(std::memory_order::seq_cst);
+
+			const std::uint64_t deadline = next_deadline_.load(std::memory_order::relaxed);
+			const bool timers_due = keeps_time ?
+				deadline <= now_tick() :
+				deadline != timer::Wheel::never && timekeeper_.load(std::memory_order::relaxed) == nullptr;
+
+			const bool stay = !has_work() && !timers_due && running_tasks.load(std::memory_order::acquire) > 0;
+
+			// a waker that already took us off the list has its token on the way
+			if (stay || !leave_idle(worker))
+			{
+				if (!stay || !keeps_time || deadline == timer::Wheel::never)
+					worker.wakeup.acquire();
+				else if (!worker.wakeup.try_acquire_until(from_tick(deadline)) && !leave_idle(worker))
+					worker.wakeup.acquire();
+			}
+
+			if (keeps_time)
+				timekeeper_.store(nullptr, std::memory_order::release);
+		}
+
+		/// Sleeps while the worker is above the limit set with set_active_workers(). The
+		/// next slot is the only place the others cannot steal from, so it is emptied
+		/// first. A wake() that picked this worker is passed on.
+		void rest(Worker& worker)
+		{
+			if (worker.next != nullptr)
+			{
+				const std::coroutine_handle<PromiseBase> next = std::exchange(worker.next, nullptr);
+				worker.deques[lane_of(next)].push(next);
+			}
+
+			worker.next_runs = 0;
+			flush_io();
+
+			if (has_work())
+				wake(1);
+
+			std::unique_lock lock(rest_mutex_);
+			rest_cv_.wait(lock, [&]() {
+				return worker.index < active_workers_.load(std::memory_order::relaxed) || running_tasks.load(std::memory_order::acquire) == 0;
+			});
+		}
+
+		/// Takes a parked worker back off the idle list, false when a waker was first.
+		bool leave_idle(Worker& worker)
+		{
+			std::scoped_lock lock(idle_mutex_);
+			auto it = std::find(idle_.begin(), idle_.end(), &worker);
+
+			if (it == idle_.end())
+				return false;
+
+			idle_.erase(it);
+			idle_count_.fetch_sub(1, std::memory_order::relaxed);
+			return true;
+		}
+
+		/// Wakes up to `count` parked workers, one per new task.
+		void wake(std::size_t count)
+		{
+			std::atomic_thread_fence(std::memory_order::seq_cst);
+
+			if (idle_count_.load(std::memory_order::relaxed) > 0)
+			{
+				std::scoped_lock lock(idle_mutex_);
+
+				for (; count > 0 && !idle_.empty(); count--)
+				{
+					Worker* worker = idle_.back();
+					idle_.pop_back();
+					idle_count_.fetch_sub(1, std::memory_order::relaxed);
+					worker->wakeup.release();
+				}
+			}
+
+#ifdef __linux__
+			if (count > 0 && poller_.load(std::memory_order::relaxed))
+				reactor_.wake();
+#endif
+		}
+
+		void flush_io()
+		{
+#ifdef __linux__
+			reactor_.flush();
+#endif
+		}
+
+		/// A timer now expires before whoever keeps time expects, wakes the timekeeper or,
+		/// if there is none, an idle worker that becomes one.
+		void wake_timekeeper()
+		{
+			std::atomic_thread_fence(std::memory_order::seq_cst);
+
+#ifdef __linux__
+			if (poller_.load(std::memory_order::relaxed))
+				reactor_.wake();
+#endif
+
+			if (idle_count_.load(std::memory_order::relaxed) == 0)
+				return;
+
+			std::scoped_lock lock(idle_mutex_);
+			Worker* keeper = timekeeper_.load(std::memory_order::relaxed);
+			auto it = idle_.end();
+
+			if (keeper != nullptr)
+				it = std::find(idle_.begin(), idle_.end(), keeper);
+			else if (!idle_.empty())
+				it = idle_.end() - 1;
+
+			if (it != idle_.end())
+			{
+				Worker* worker = *it;
+				idle_.erase(it);
+				idle_count_.fetch_sub(1, std::memory_order::relaxed);
+				worker->wakeup.release();
+			}
+		}
+
+		/// Runs the callbacks of due timers, true when there were any. A wheel somebody
+		/// else is expiring is skipped, they bring next_deadline_ up to date afterwards.
+		bool expire_timers()
+		{
+			const std::uint64_t now = now_tick();
+			const std::uint64_t deadline = next_deadline_.load(std::memory_order::acquire);
+
+			if (deadline == timer::Wheel::never || deadline > now)
+				return false;
+
+			std::uint64_t count = 0;
+
+			for (const auto& worker : workers_)
+			{
+				if (worker->next_deadline.load(std::memory_order::acquire) > now)
+					continue;
+
+				std::unique_lock lock(worker->timer_mutex, std::try_to_lock);
+
+				if (!lock.owns_lock())
+					continue;
+
+				timer::Timer* fired = worker->timers.advance(now);
+				worker->next_deadline.store(worker->timers.next_deadline(), std::memory_order::seq_cst);
+				lock.unlock();
+
+				while (fired != nullptr)
+				{
+					// the callback may free the timer
+					timer::Timer* next = fired->next;
+					fired->callback(*fired);
+					fired = next;
+					count++;
+				}
+			}
+
+			refresh_next_deadline();
+			Counters::add(current_worker_->counters.timers_fired, count);
+			return count > 0;
+		}
+
+		/// The wheel add_timer() uses: the calling worker's own, or one picked by thread
+		/// for threads outside the pool.
+		[[nodiscard]] Worker& timer_worker() const noexcept
+		{
+			if (Worker* worker = local_worker())
+				return *worker;
+
+			return *workers_[std::hash<std::thread::id>{}(std::this_thread::get_id()) % workers_.size()];
+		}
+
+		/// Lowers next_deadline_ to `deadline`, true when it was later.
+		bool lower_next_deadline(std::uint64_t deadline) noexcept
+		{
+			std::uint64_t current = next_deadline_.load(std::memory_order::seq_cst);
+
+			while (deadline < current)
+			{
+				if (next_deadline_.compare_exchange_weak(current, deadline, std::memory_order::seq_cst))
+					return true;
+			}
+
+			return false;
+		}
+
+		/// Sets next_deadline_ to the earliest deadline of all wheels. add_timer() lowers
+		/// its wheel's deadline before next_deadline_, so one whose fetch-min was lost to
+		/// the store is seen by the second pass.
+		void refresh_next_deadline() noexcept
+		{
+			std::uint64_t next = timer::Wheel::never;
+
+			for (const auto& worker : workers_)
+				next = std::min(next, worker->next_deadline.load(std::memory_order::seq_cst));
+
+			next_deadline_.store(next, std::memory_order::seq_cst);
+
+			for (const auto& worker : workers_)
+				(void)lower_next_deadline(worker->next_deadline.load(std::memory_order::seq_cst));
+		}
+
+		[[nodiscard]] std::uint64_t now_tick() const noexcept
+		{
+			return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - epoch_).count());
+		}
+
+		/// Rounds up, a timer never fires early.
+		[[nodiscard]] std::uint64_t to_tick(std::chrono::steady_clock::time_point time) const noexcept
+		{
+			if (time <= epoch_)
+				return 0;
+
+			return static_cast<std::uint64_t>(std::chrono::ceil<std::chrono::milliseconds>(time - epoch_).count());
+		}
+
+		[[nodiscard]] std::chrono::steady_clock::time_point from_tick(std::uint64_t tick) const noexcept
+		{
+			if (tick == timer::Wheel::never)
+				return std::chrono::steady_clock::time_point::max();
+
+			return epoch_ + std::chrono::milliseconds(tick);
+		}
+
+		/// Delivers finished I/O without blocking, true when anything completed.
+		bool poll_io()
+		{
+#ifdef __linux__
+			if (reactor_.pending() == 0)
+				return false;
+
+			const std::size_t completed = reactor_.poll(false);
+			Counters::add(current_worker_->counters.io_completions, completed);
+			return completed > 0;
+#else
+			return false;
+#endif
+		}
+
+		[[nodiscard]] bool has_work() const noexcept
+		{
+			for (auto& node : nodes_)
+			{
+				for (auto& queue : node->queues)
+				{
+					if (!queue.empty())
+						return true;
+				}
+			}
+
+			for (auto& worker : workers_)
+			{
+				for (auto& deque : worker->deques)
+				{
+					if (!deque.empty())
+						return true;
+				}
+			}
+
+			return false;
+		}
+
+		/// The handle must not be touched after resume(), completion is handled by
+		/// PromiseBase::FinalAwaiter and the frame may already be gone.
+		bool run_next_task()
+		{
+			auto handle = next_task();
+
+			if (handle == nullptr)
+				return false;
+
+			Counters::add(current_worker_->counters.tasks_run);
+			handle.resume();
+			return true;
+		}
+
+		/// Called from the final suspend point of a root task.
+		void finish(std::coroutine_handle<PromiseBase> handle)
+		{
+			if (handle.promise().exception)
+			{
+				std::scoped_lock lock(exception_mutex_);
+				if (!exception_)
+					exception_ = handle.promise().exception;
+			}
+
+			handle.destroy();
+
+			if (Worker* worker = local_worker())
+				Counters::add(worker->counters.tasks_finished);
+
+			release_task();
+		}
+
+		/// The next slot goes first, up to next_limit times in a row. After that the lane
+		/// whose turn it is goes first, see lane_cycle. Work of our own comes
+		/// before stealing, except for high priority tasks: those do not wait for a busy
+		/// worker to get around to them.
+		[[nodiscard]] std::coroutine_handle<PromiseBase> next_task()
+		{
+			Worker& worker = *current_worker_;
+
+			if (worker.next != nullptr)
+			{
+				auto handle = std::exchange(worker.next, nullptr);
+
+				if (worker.next_runs++ < next_limit)
+				{
+					Counters::add(worker.counters.next_runs);
+					return handle;
+				}
+
+				// it had its turns, it queues up like everything else and the shared
+				// queues, which our deque would hold back as well, go first
+				worker.deques[lane_of(handle)].push(handle);
+				worker.next_runs = 0;
+
+				for (std::size_t lane = 0; lane < priority_count; lane++)
+				{
+					if (auto queued = take_queued(worker, *nodes_[worker.node], lane))
+						return queued;
+				}
+			}
+
+			worker.next_runs = 0;
+			const std::size_t first = static_cast<std::size_t>(lane_cycle[worker.turn]);
+
+			if (++worker.turn == lane_cycle.size())
+				worker.turn = 0;
+
+			for (std::size_t i = 0; i < priority_count; i++)
+			{
+				// first, then the others in order of priority
+				const std::size_t lane = i == 0 ? first : i - (i <= first);
+
+				if (auto handle = take(worker, lane))
+					return handle;
+
+				if (lane == static_cast<std::size_t>(Priority::high))
+				{
+					if (auto handle = steal(worker, lane))
+						return handle;
+				}
+			}
+
+			return steal(worker);
+		}
+
+		[[nodiscard]] std::coroutine_handle<PromiseBase> take(Worker& worker, std::size_t lane)
+		{
+			std::coroutine_handle<PromiseBase> handle = nullptr;
+
+			if (worker.deques[lane].try_pop(handle))
+				return handle;
+
+			return take_queued(worker, *nodes_[worker.node], lane);
+		}
+
+		/// Takes a batch off a node's shared queue, the rest goes onto our deque where idle
+		/// workers can steal it.
+		[[nodiscard]] std::coroutine_handle<PromiseBase> take_queued(Worker& worker, Node& node, std::size_t lane)
+		{
+			Queue& queue = node.queues[lane];
+
+			if (queue.size() <= 0)
+				return nullptr;
+
+			std::coroutine_handle<PromiseBase> batch[queue_batch];
+			const std::size_t count = queue.try_pop_n(batch, queue_batch);
+
+			if (count == 0)
+				return nullptr;
+
+			worker.deques[lane].push_n(batch + 1, count - 1);
+			return batch[0];
+		}
+
+		/// Strictly by priority, an idle worker should pick up the urgent work first.
+		[[nodiscard]] std::coroutine_handle<PromiseBase> steal(Worker& thief)
+		{
+			for (std::size_t lane = 0; lane < priority_count; lane++)
+			{
+				if (auto handle = steal(thief, lane))
+					return handle;
+			}
+
+			return nullptr;
+		}
+
+		/// Workers of our own node first, their frames and data are close by. Only then
+		/// the shared queues and workers of the other nodes.
+		[[nodiscard]] std::coroutine_handle<PromiseBase> steal(Worker& thief, std::size_t lane)
+		{
+			if (auto handle = steal_from(thief, nodes_[thief.node]->workers, lane))
+				return handle;
+
+			for (std::size_t i = 1; i < nodes_.size(); i++)
+			{
+				Node& node = *nodes_[(thief.node + i) % nodes_.size()];
+				auto handle = take_queued(thief, node, lane);
+
+				if (handle == nullptr)
+					handle = steal_from(thief, node.workers, lane);
+
+				if (handle != nullptr)
+				{
+					Counters::add(thief.counters.remote_steals);
+					return handle;
+				}
+			}
+
+			return nullptr;
+		}
+
+		[[nodiscard]] std::coroutine_handle<PromiseBase> steal_from(Worker& thief, std::span<Worker* const> victims, std::size_t lane)
+		{
+			const std::size_t count = victims.size();
+
+			if (count == 0 || (count == 1 && victims[0] == &thief))
+				return nullptr;
+
+			// xorshift, so not every idle worker hammers the same victim
+			thief.seed ^= thief.seed << 13;
+			thief.seed ^= thief.seed >> 7;
+			thief.seed ^= thief.seed << 17;
+
+			const std::size_t start = static_cast<std::size_t>(thief.seed % count);
+			std::coroutine_handle<PromiseBase> handle = nullptr;
+
+			for (std::size_t i = 0; i < count; i++)
+			{
+				Worker& victim = *victims[(start + i) % count];
+
+				// the cheap check first, try_steal() fences
+				if (&victim != &thief && !victim.deques[lane].empty() && victim.deques[lane].try_steal(handle))
+				{
+					Counters::add(thief.counters.steals);
+					return handle;
+				}
+			}
+
+			return nullptr;
+		}
+
+		/// Number of root tasks, children and awaited tasks are kept alive by their root.
+		std::atomic<std::size_t> running_tasks = 0;
+		const std::size_t max_workers;
+		std::vector<std::unique_ptr<Worker>> workers_ = {};
+		std::vector<std::unique_ptr<Node>> nodes_ = {};
+		/// Index into nodes_ of every CPU, no_node for CPUs without workers on their node.
+		/// Empty with a single node.
+		std::vector<std::size_t> cpu_nodes_ = {};
+		std::atomic<std::size_t> next_node_ = 0;
+		std::vector<std::thread> threads_ = {};
+		std::mutex idle_mutex_;
+		std::vector<Worker*> idle_ = {};
+		std::atomic<std::size_t> idle_count_ = 0;
+		std::mutex exception_mutex_;
+		std::exception_ptr exception_ = nullptr;
+		const std::chrono::steady_clock::time_point epoch_ = std::chrono::steady_clock::now();
+		/// No later than the earliest timer in any worker's wheel, read to see whether
+		/// anything is due. It may lag behind a cancellation until the next expiry.
+		std::atomic<std::uint64_t> next_deadline_ = timer::Wheel::never;
+		std::atomic<Worker*> timekeeper_ = nullptr;
+		std::atomic<std::size_t> active_workers_ = 0;
+		std::mutex rest_mutex_;
+		std::condition_variable rest_cv_;
+#ifdef __linux__
+		io::Reactor reactor_;
+		std::atomic<bool> poller_ = false;
+#endif
+		/// Last, so it is gone before anything its jobs resume tasks through.
+		blocking::Pool blocking_;
+	};
+
+	inline std::coroutine_handle<> PromiseBase::FinalAwaiter::await_suspend(std::coroutine_handle<> handle) const noexcept
+	{
+		auto& promise = PromiseBase::cast(handle).promise();
+		auto awaiting = promise.awaiting_coro;
+
+		if (awaiting == nullptr)
+		{
+			Scheduler::current()->finish(PromiseBase::cast(handle));
+			return std::noop_coroutine();
+		}
+
+		// the awaiting coroutine may be resumed (and destroy us) as soon as the count drops
+		if (awaiting.promise().awaiting_count.fetch_sub(1, std::memory_order::acq_rel) == 1)
+			return awaiting;
+
+		return std::noop_coroutine();
+	}
+
+	template<typename T, typename Allocator = DefaultAllocator>
+	class Task
+	{
+	public:
+		struct promise_type : public PromiseBase
+		{
+			[[nodiscard]] static void* operator new(std::size_t size)
+			{
+				return Allocator::alloc(size);
+			}
+
+			static void operator delete(void* ptr)
+			{
+				Allocator::free(ptr);
+			}
+
+			[[nodiscard]] constexpr Task<T, Allocator> get_return_object() noexcept { return Task<T, Allocator>(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+			constexpr void return_value(const T& val) noexcept
+			{
+				if (exception)
+					std::rethrow_exception(exception);
+				value.emplace(std::move(val));
+			}
+
+			constexpr void return_value(T&& val)
+			{
+				if (exception)
+					std::rethrow_exception(exception);
+				value.emplace(std::move(val));
+			}
+
+			std::optional<T> value;
+		};
+
+		using Handle = std::coroutine_handle<promise_type>;
+
+		Task(Handle handle) : handle(handle) {}
+		Task(const Task& task) = delete;
+		Task(Task&& task) noexcept : handle(std::exchange(task.handle, nullptr)) {}
+		~Task() {}
+
+		[[nodiscard]] auto operator co_await() const noexcept
+		{
+			struct Awaiter
+			{
+				constexpr bool await_ready() const noexcept { return false; }
+
+				[[nodiscard]] constexpr T await_resume() const
+				{
+					if (cancelled)
+						throw OperationCancelled();
+
+					if (coro.promise().exception)
+						std::rethrow_exception(coro.promise().exception);
+
+					return std::move(coro.promise().value.value());
+				}
+
+				/// Starts the awaited task inline on this thread, its final suspend point
+				/// transfers straight back to us. A cancelled task does not start it.
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting_handle) noexcept
+				{
+					auto handle = PromiseBase::cast(awaiting_handle);
+					auto& promise = handle.promise();
+
+					if (promise.cancellation.cancelled())
+					{
+						cancelled = true;
+						return awaiting_handle;
+					}
+
+					coro.promise().awaiting_coro = handle;
+					promise.inherit(coro.promise());
+					promise.awaiting_count.store(1, std::memory_order::release);
+					return coro;
+				}
+
+				std::coroutine_handle<promise_type> coro;
+				bool cancelled = false;
+
+				Awaiter(std::coroutine_handle<promise_type> coro) noexcept : coro(coro) {}
+				~Awaiter() { coro.destroy(); }
+			};
+
+			return Awaiter(handle);
+		}
+
+		Handle handle;
+	};
+
+	template<typename Allocator>
+	class Task<void, Allocator>
+	{
+	public:
+		struct promise_type : public PromiseBase
+		{
+			[[nodiscard]] static void* operator new(std::size_t size)
+			{
+				return Allocator::alloc(size);
+			}
+
+			static void operator delete(void* ptr)
+			{
+				Allocator::free(ptr);
+			}
+
+			[[nodiscard]] Task<void, Allocator> get_return_object() noexcept { return Task<void, Allocator>(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+			constexpr void return_void() const
+			{
+				if (exception)
+					std::rethrow_exception(exception);
+			}
+		};
+
+		using Handle = std::coroutine_handle<promise_type>;
+
+		Task(Handle handle) : handle(handle) {}
+		Task(const Task& task) = delete;
+		Task(Task&& task) noexcept : handle(std::exchange(task.handle, nullptr)) {}
+		~Task() {}
+
+		[[nodiscard]] auto operator co_await() noexcept
+		{
+			struct Awaiter
+			{
+				constexpr bool await_ready() const noexcept { return false; }
+
+				constexpr void await_resume() const
+				{
+					if (cancelled)
+						throw OperationCancelled();
+
+					if (coro.promise().exception)
+						std::rethrow_exception(coro.promise().exception);
+				}
+
+				/// Starts the awaited task inline on this thread, its final suspend point
+				/// transfers straight back to us. A cancelled task does not start it.
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting_handle) noexcept
+				{
+					auto handle = PromiseBase::cast(awaiting_handle);
+					auto& promise = handle.promise();
+
+					if (promise.cancellation.cancelled())
+					{
+						cancelled = true;
+						return awaiting_handle;
+					}
+
+					coro.promise().awaiting_coro = handle;
+					promise.inherit(coro.promise());
+					promise.awaiting_count.store(1, std::memory_order::release);
+					return coro;
+				}
+
+				std::coroutine_handle<promise_type> coro;
+				bool cancelled = false;
+
+				Awaiter(std::coroutine_handle<promise_type> coro) noexcept : coro(coro) {}
+				~Awaiter() { coro.destroy(); }
+			};
+
+			return Awaiter(handle);
+		}
+
+		Handle handle;
+	};
+
+	template<typename T, typename Allocator = DefaultAllocator>
+	struct MultipleAwaiter
+	{
+		constexpr bool await_ready() const noexcept { return coros.empty(); }
+
+		[[nodiscard]] constexpr std::vector<T> await_resume() const
+		{
+			if (cancelled)
+				throw OperationCancelled();
+
+			std::vector<T> results;
+			results.reserve(coros.size());
+			for (auto& coro : coros)
+			{
+				using P = Task<T, Allocator>::promise_type;
+				auto x = std::coroutine_handle<P>::from_address(coro.address());
+				auto& p = x.promise();
+
+				if (p.exception)
+					std::rethrow_exception(p.exception);
+
+				results.emplace_back(std::move(p.value.value()));
+			}
+			return results;
+		}
+
+		/// The first task runs inline, the others are spread over the workers. The parent
+		/// cannot be resumed before the first task has run, so it is safe to touch `coros`
+		/// until we return.
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting_handle)
+		{
+			auto handle = PromiseBase::cast(awaiting_handle);
+
+			auto& promise = handle.promise();
+			Scheduler* scheduler = Scheduler::current();
+
+			if (promise.cancellation.cancelled())
+			{
+				cancelled = true;
+				return awaiting_handle;
+			}
+
+			promise.awaiting_count.store(static_cast<std::uint32_t>(coros.size()), std::memory_order::release);
+
+			for (auto& coro : coros)
+			{
+				coro.promise().awaiting_coro = handle;
+				promise.inherit(coro.promise());
+			}
+
+			scheduler->schedule_awaiting(std::span(coros).subspan(1));
+
+			return coros.front();
+		}
+
+		MultipleAwaiter(std::initializer_list<Task<T, Allocator>> tasks) : coros()
+		{
+			for (auto& coro : tasks)
+				coros.emplace_back(PromiseBase::cast(coro.handle));
+		}
+
+		MultipleAwaiter(std::vector<Task<T, Allocator>>&& tasks) : coros()
+		{
+			for (auto& coro : tasks)
+				coros.emplace_back(PromiseBase::cast(coro.handle));
+		}
+
+		~MultipleAwaiter()
+		{
+			for (auto& coro : coros)
+				coro.destroy();
+		}
+
+		std::vector<std::coroutine_handle<PromiseBase>> coros;
+		bool cancelled = false;
+	};
+
+	template<typename Allocator>
+	struct MultipleAwaiter<void, Allocator>
+	{
+		[[nodiscard]] constexpr bool await_ready() const noexcept { return coros.empty(); }
+
+		constexpr void await_resume() const
+		{
+			if (cancelled)
+				throw OperationCancelled();
+
+			for (auto& coro : coros)
+			{
+				auto& promise = PromiseBase::cast(coro).promise();
+
+				if (promise.exception)
+					std::rethrow_exception(promise.exception);
+			}
+		}
+
+		/// The first task runs inline, the others are spread over the workers. The parent
+		/// cannot be resumed before the first task has run, so it is safe to touch `coros`
+		/// until we return.
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting_handle)
+		{
+			auto handle = PromiseBase::cast(awaiting_handle);
+
+			auto& promise = handle.promise();
+			Scheduler* scheduler = Scheduler::current();
+
+			if (promise.cancellation.cancelled())
+			{
+				cancelled = true;
+				return awaiting_handle;
+			}
+
+			promise.awaiting_count.store(static_cast<std::uint32_t>(coros.size()), std::memory_order::release);
+
+			for (auto& coro : coros)
+			{
+				coro.promise().awaiting_coro = handle;
+				promise.inherit(coro.promise());
+			}
+
+			scheduler->schedule_awaiting(std::span(coros).subspan(1));
+
+			return coros.front();
+		}
+
+		MultipleAwaiter(std::initializer_list<Task<void, Allocator>> tasks) : coros()
+		{
+			for (auto& coro : tasks)
+				coros.emplace_back(PromiseBase::cast(coro.handle));
+		}
+
+		MultipleAwaiter(std::vector<Task<void, Allocator>>&& tasks) : coros()
+		{
+			for (auto& coro : tasks)
+				coros.emplace_back(PromiseBase::cast(coro.handle));
+		}
+
+		~MultipleAwaiter()
+		{
+			for (auto& coro : coros)
+				coro.destroy();
+		}
+
+		std::vector<std::coroutine_handle<PromiseBase>> coros;
+		bool cancelled = false;
+	};
+
+	template<typename T, typename Allocator = DefaultAllocator>
+	[[nodiscard]] auto all(std::initializer_list<Task<T, Allocator>> elements)
+	{
+		return MultipleAwaiter<T, Allocator>(std::move(elements));
+	};
+
+	template<typename Allocator = DefaultAllocator>
+	[[nodiscard]] auto all(std::initializer_list<Task<void, Allocator>> elements)
+	{
+		return MultipleAwaiter<void, Allocator>(std::move(elements));
+	};
+
+	template<typename T, typename Allocator = DefaultAllocator>
+	[[nodiscard]] auto all(std::vector<Task<T, Allocator>>&& elements)
+	{
+		return MultipleAwaiter<T, Allocator>(std::move(elements));
+	};
+
+	template<typename Allocator = DefaultAllocator>
+	[[nodiscard]] auto all(std::vector<Task<void, Allocator>>&& elements)
+	{
+		return MultipleAwaiter<void, Allocator>(std::move(elements));
+	};
+
+	template<typename T>
+	struct TaskResult;
+
+	/// Task<void> has no value, all() puts an empty std::monostate in its place.
+	template<typename T, typename Allocator>
+	struct TaskResult<Task<T, Allocator>>
+	{
+		using type = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+	};
+
+	/// Awaits tasks of different types, see all(Task<Ts, As>...). The handles live in
+	/// the awaiter itself, so nothing is allocated besides the frames of the tasks.
+	template<typename... Tasks>
+	struct TupleAwaiter
+	{
+		static constexpr std::size_t count = sizeof...(Tasks);
+
+		explicit TupleAwaiter(Tasks&&... tasks) noexcept : coros{ PromiseBase::cast(std::exchange(tasks.handle, nullptr))... } {}
+
+		TupleAwaiter(const TupleAwaiter&) = delete;
+		TupleAwaiter& operator=(const TupleAwaiter&) = delete;
+
+		~TupleAwaiter()
+		{
+			for (auto& coro : coros)
+				coro.destroy();
+		}
+
+		constexpr bool await_ready() const noexcept { return false; }
+
+		/// The first task runs inline, the others are queued as one batch, see MultipleAwaiter.
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting_handle)
+		{
+			auto handle = PromiseBase::cast(awaiting_handle);
+
+			auto& promise = handle.promise();
+			Scheduler* scheduler = Scheduler::current();
+
+			if (promise.cancellation.cancelled())
+			{
+				cancelled = true;
+				return awaiting_handle;
+			}
+
+			promise.awaiting_count.store(count, std::memory_order::release);
+
+			for (auto& coro : coros)
+			{
+				coro.promise().awaiting_coro = handle;
+				promise.inherit(coro.promise());
+			}
+
+			if constexpr (count > 1)
+				scheduler->schedule_awaiting(std::span(coros).subspan(1));
+
+			return coros.front();
+		}
+
+		/// Rethrows the exception of the first task that failed, otherwise moves every
+		/// result out of its promise.
+		[[nodiscard]] std::tuple<typename TaskResult<Tasks>::type...> await_resume() const
+		{
+			if (cancelled)
+				throw OperationCancelled();
+
+			for (auto& coro : coros)
+			{
+				if (coro.promise().exception)
+					std::rethrow_exception(coro.promise().exception);
+			}
+
+			return results(std::index_sequence_for<Tasks...>());
+		}
+
+	private:
+		template<std::size_t... Is>
+		std::tuple<typename TaskResult<Tasks>::type...> results(std::index_sequence<Is...>) const
+		{
+			return std::tuple<typename TaskResult<Tasks>::type...>(result<Tasks>(coros[Is])...);
+		}
+
+		template<typename Task>
+		static typename TaskResult<Task>::type result(std::coroutine_handle<PromiseBase> coro)
+		{
+			if constexpr (std::is_same_v<typename TaskResult<Task>::type, std::monostate>)
+			{
+				return {};
+			}
+			else
+			{
+				auto& promise = std::coroutine_handle<typename Task::promise_type>::from_address(coro.address()).promise();
+				return std::move(promise.value.value());
+			}
+		}
+
+		std::array<std::coroutine_handle<PromiseBase>, count> coros;
+		bool cancelled = false;
+	};
+
+	/// Runs tasks of different types side by side, `auto [a, b] = co_await all(f(), g());`
+	template<typename... Ts, typename... Allocators>
+		requires (sizeof...(Ts) > 0)
+	[[nodiscard]] auto all(Task<Ts, Allocators>... tasks)
+	{
+		return TupleAwaiter<Task<Ts, Allocators>...>(std::move(tasks)...);
+	}
+
+	/// Gives the task (and everything it awaits) its own token instead of inheriting the
+	/// one of whoever awaits it, also works for root tasks passed to Scheduler::schedule().
+	template<typename T, typename Allocator>
+	[[nodiscard]] Task<T, Allocator> with_cancellation(Task<T, Allocator> task, CancellationToken token)
+	{
+		task.handle.promise().cancellation = std::move(token);
+		return task;
+	}
+
+	/// `co_await cancellation_point();` throws OperationCancelled when the task has been
+	/// cancelled, for loops that would not suspend otherwise. Never suspends.
+	struct CancellationPoint
+	{
+		constexpr bool await_ready() const noexcept { return false; }
+
+		bool await_suspend(std::coroutine_handle<> handle) noexcept
+		{
+			cancelled = PromiseBase::cast(handle).promise().cancellation.cancelled();
+			return false;
+		}
+
+		void await_resume() const
+		{
+			if (cancelled)
+				throw OperationCancelled();
+		}
+
+		bool cancelled = false;
+	};
+
+	[[nodiscard]] inline CancellationPoint cancellation_point() noexcept
+	{
+		return {};
+	}
+
+	/// `auto token = co_await current_cancellation();` the token of the running task, e.g.
+	/// to hand to code that polls it. Never suspends.
+	struct CurrentCancellation
+	{
+		constexpr bool await_ready() const noexcept { return false; }
+
+		bool await_suspend(std::coroutine_handle<> handle) noexcept
+		{
+			token = PromiseBase::cast(handle).promise().cancellation;
+			return false;
+		}
+
+		CancellationToken await_resume() noexcept
+		{
+			return std::move(token);
+		}
+
+		CancellationToken token = {};
+	};
+
+	[[nodiscard]] inline CurrentCancellation current_cancellation() noexcept
+	{
+		return {};
+	}
+
+	/// Suspends the awaiting task until `deadline` without holding up a worker.
+	struct SleepAwaiter : public timer::Timer
+	{
+		explicit SleepAwaiter(std::chrono::steady_clock::time_point deadline) : timer::Timer(),
+			deadline_(deadline)
+		{}
+
+		SleepAwaiter(const SleepAwaiter&) = delete;
+		SleepAwaiter& operator=(const SleepAwaiter&) = delete;
+
+		bool await_ready() const noexcept
+		{
+			return deadline_ <= std::chrono::steady_clock::now();
+		}
+
+		/// Cancelling the task disarms the timer and resumes it right away.
+		bool await_suspend(std::coroutine_handle<> handle)
+		{
+			handle_ = PromiseBase::cast(handle);
+			auto& promise = handle_.promise();
+
+			if (promise.cancellation.cancelled())
+			{
+				cancelled_ = true;
+				return false;
+			}
+
+			callback = onExpired;
+			scheduler_ = Scheduler::current();
+			scheduler_->add_timer(*this, deadline_);
+
+			canceller_.function = onCancelled;
+			canceller_.awaiter = this;
+
+			if (!promise.cancellation.add(canceller_))
+				onCancelled(canceller_);
+
+			// the timer or the token may have fired already, they leave resuming to us
+			return steps_.fetch_add(1, std::memory_order::acq_rel) == 0;
+		}
+
+		void await_resume()
+		{
+			if (handle_ != nullptr)
+				handle_.promise().cancellation.remove(canceller_);
+
+			if (cancelled_)
+				throw OperationCancelled();
+		}
+
+	private:
+		struct Canceller : public CancellationCallback
+		{
+			SleepAwaiter* awaiter = nullptr;
+		};
+
+		/// Resumes the task once both await_suspend() and the timer or token are done.
+		void finish()
+		{
+			if (steps_.fetch_add(1, std::memory_order::acq_rel) == 1)
+				scheduler_->schedule_awaiting(handle_);
+		}
+
+		static void onExpired(timer::Timer& timer)
+		{
+			static_cast<SleepAwaiter&>(timer).finish();
+		}
+
+		static void onCancelled(CancellationCallback& callback)
+		{
+			SleepAwaiter& s = *static_cast<Canceller&>(callback).awaiter;
+
+			// otherwise the timer fired and resumes the task
+			if (s.scheduler_->cancel_timer(s))
+			{
+				s.cancelled_ = true;
+				s.finish();
+			}
+		}
+
+		std::chrono::steady_clock::time_point deadline_;
+		std::coroutine_handle<PromiseBase> handle_ = nullptr;
+		/// The token may fire on any thread.
+		Scheduler* scheduler_ = nullptr;
+		Canceller canceller_ = {};
+		std::atomic<int> steps_ = 0;
+		bool cancelled_ = false;
+	};
+
+	template<typename Clock, typename Duration>
+	[[nodiscard]] SleepAwaiter sleep_until(std::chrono::time_point<Clock, Duration> deadline)
+	{
+		if constexpr (std::is_same_v<Clock, std::chrono::steady_clock>)
+			return SleepAwaiter(std::chrono::time_point_cast<std::chrono::steady_clock::duration>(deadline));
+		else
+			return SleepAwaiter(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(deadline - Clock::now()));
+	}
+
+	template<typename Rep, typename Period>
+	[[nodiscard]] SleepAwaiter sleep_for(std::chrono::duration<Rep, Period> duration)
+	{
+		return SleepAwaiter(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration));
+	}
+
+	/// Runs a blocking call on the scheduler's blocking pool, see offload().
+	template<typename Fn>
+	class OffloadAwaiter : public blocking::Job
+	{
+	public:
+		using Result = std::remove_cvref_t<std::invoke_result_t<Fn&>>;
+
+		explicit OffloadAwaiter(Fn fn) : blocking::Job(),
+			fn_(std::move(fn))
+		{}
+
+		OffloadAwaiter(const OffloadAwaiter&) = delete;
+		OffloadAwaiter& operator=(const OffloadAwaiter&) = delete;
+
+		constexpr bool await_ready() const noexcept { return false; }
+
+		/// A task that is cancelled already does not start the call.
+		bool await_suspend(std::coroutine_handle<> handle)
+		{
+			handle_ = PromiseBase::cast(handle);
+
+			if (handle_.promise().cancellation.cancelled())
+			{
+				cancelled_ = true;
+				return false;
+			}
+
+			run = onRun;
+			scheduler_ = Scheduler::current();
+			scheduler_->blocking_pool().submit(*this);
+			return true;
+		}
+
+		Result await_resume()
+		{
+			if (cancelled_)
+				throw OperationCancelled();
+
+			if (exception_)
+				std::rethrow_exception(exception_);
+
+			if constexpr (!std::is_void_v<Result>)
+				return std::move(*result_);
+		}
+
+	private:
+		using Value = std::conditional_t<std::is_void_v<Result>, std::monostate, Result>;
+
+		static void onRun(blocking::Job& job)
+		{
+			OffloadAwaiter& s = static_cast<OffloadAwaiter&>(job);
+
+			try
+			{
+				if constexpr (std::is_void_v<Result>)
+				{
+					std::invoke(s.fn_);
+					s.result_.emplace();
+				}
+				else
+				{
+					s.result_.emplace(std::invoke(s.fn_));
+				}
+			}
+			catch (...)
+			{
+				s.exception_ = std::current_exception();
+			}
+
+			// from a thread outside the pool, so the task goes through the shared queue
+			s.scheduler_->schedule_awaiting(s.handle_);
+		}
+
+		Fn fn_;
+		std::optional<Value> result_ = std::nullopt;
+		std::exception_ptr exception_ = nullptr;
+		std::coroutine_handle<PromiseBase> handle_ = nullptr;
+		Scheduler* scheduler_ = nullptr;
+		bool cancelled_ = false;
+	};
+
+	/// `auto data = co_await offload([&]() { return compress(input); });` runs `fn` on
+	/// the scheduler's blocking pool and resumes the task on a worker once it returned,
+	/// with its result or exception. For calls that block the thread (fsync, DNS,
+	/// legacy APIs): the workers keep running tasks meanwhile, however long the call
+	/// takes. A task that is cancelled already throws OperationCancelled without making
+	/// the call, a call that was made runs to the end.
+	template<typename Fn>
+	[[nodiscard]] OffloadAwaiter<std::decay_t<Fn>> offload(Fn&& fn)
+	{
+		return OffloadAwaiter<std::decay_t<Fn>>(std::forward<Fn>(fn));
+	}
+
+	/// Races a task against a timer. The task runs as a detached root task, whichever
+	/// side finishes first resumes the waiter. A late task is cancelled and left to
+	/// finish on its own, its result is dropped.
+	template<typename T, typename Allocator>
+	class TimeoutAwaiter
+	{
+	public:
+		TimeoutAwaiter(Task<T, Allocator>&& task, std::chrono::steady_clock::time_point deadline) :
+			task_(std::move(task)),
+			deadline_(deadline)
+		{}
+
+		TimeoutAwaiter(const TimeoutAwaiter&) = delete;
+		TimeoutAwaiter& operator=(const TimeoutAwaiter&) = delete;
+
+		~TimeoutAwaiter()
+		{
+			if (state_ != nullptr)
+				state_->release();
+			else if (task_.handle)
+				task_.handle.destroy();
+		}
+
+		constexpr bool await_ready() const noexcept { return false; }
+
+		void await_suspend(std::coroutine_handle<> handle)
+		{
+			auto waiter = PromiseBase::cast(handle);
+			Scheduler* scheduler = Scheduler::current();
+			State* state = new State(waiter);
+			state_ = state;
+
+			auto driver = drive(std::move(task_), state);
+			driver.handle.promise().cancellation = state->source.token();
+
+			// either side may resume the waiter (and destroy us) from here on
+			scheduler->add_timer(state->timer, deadline_);
+			scheduler->schedule(driver, waiter.promise().priority);
+		}
+
+		/// Empty (or false for Task<void>) when the deadline passed first.
+		auto await_resume()
+		{
+			if constexpr (std::is_void_v<T>)
+			{
+				if (state_->timed_out)
+					return false;
+
+				if (state_->exception)
+					std::rethrow_exception(state_->exception);
+
+				return true;
+			}
+			else
+			{
+				if (state_->timed_out)
+					return std::optional<T>();
+
+				if (state_->exception)
+					std::rethrow_exception(state_->exception);
+
+				return std::optional<T>(std::move(state_->value));
+			}
+		}
+
+	private:
+		struct Empty {};
+
+		/// Shared by the awaiter, the driver and the timer, the last one out deletes it.
+		/// The task is cancelled when the deadline passes or the waiter is cancelled.
+		struct State
+		{
+			explicit State(std::coroutine_handle<PromiseBase> waiter) :
+				waiter(waiter),
+				scheduler(Scheduler::current()),
+				source(waiter.promise().cancellation)
+			{
+				timer.callback = onTimeout;
+				timer.state = this;
+			}
+
+			void settle(bool late)
+			{
+				if (settled.exchange(true, std::memory_order::acq_rel))
+					return;
+
+				timed_out = late;
+				scheduler->schedule_awaiting(waiter);
+			}
+
+			void release()
+			{
+				if (refs.fetch_sub(1, std::memory_order::acq_rel) == 1)
+					delete this;
+			}
+
+			struct Deadline : public timer::Timer
+			{
+				State* state = nullptr;
+			};
+
+			static void onTimeout(timer::Timer& timer)
+			{
+				State* state = static_cast<Deadline&>(timer).state;
+				state->settle(true);
+				state->source.cancel();
+				state->release();
+			}
+
+			std::coroutine_handle<PromiseBase> waiter;
+			Scheduler* const scheduler;
+			CancellationSource source;
+			Deadline timer = {};
+			std::conditional_t<std::is_void_v<T>, Empty, std::optional<T>> value = {};
+			std::exception_ptr exception = nullptr;
+			bool timed_out = false;
+			std::atomic<bool> settled = false;
+			std::atomic<std::size_t> refs = 3;
+		};
+
+		static Task<void, Allocator> drive(Task<T, Allocator> task, State* state)
+		{
+			try
+			{
+				if constexpr (std::is_void_v<T>)
+					co_await task;
+				else
+					state->value.emplace(co_await task);
+			}
+			catch (...)
+			{
+				state->exception = std::current_exception();
+			}
+
+			state->settle(false);
+
+			// the timer holds a reference until it fired or is cancelled
+			if (state->scheduler->cancel_timer(state->timer))
+				state->release();
+
+			state->release();
+		}
+
+		Task<T, Allocator> task_;
+		std::chrono::steady_clock::time_point deadline_;
+		State* state_ = nullptr;
+	};
+
+	/// Waits at most `timeout` for the task, returns its value or an empty optional.
+	template<typename T, typename Allocator, typename Rep, typename Period>
+		requires (!std::is_void_v<T>)
+	Task<std::optional<T>> with_timeout(Task<T, Allocator> task, std::chrono::duration<Rep, Period> timeout)
+	{
+		co_return co_await TimeoutAwaiter<T, Allocator>(std::move(task), std::chrono::steady_clock::now() + timeout);
+	}
+
+	/// Waits at most `timeout` for the task, false when it did not finish in time.
+	template<typename Allocator, typename Rep, typename Period>
+	Task<bool> with_timeout(Task<void, Allocator> task, std::chrono::duration<Rep, Period> timeout)
+	{
+		co_return co_await TimeoutAwaiter<void, Allocator>(std::move(task), std::chrono::steady_clock::now() + timeout);
+	}
+
+	/// Result of when_any(): which task finished first and its value.
+	template<typename T>
+	struct AnyResult
+	{
+		std::size_t index;
+		T value;
+	};
+
+	/// Resumes the waiter as soon as the first of the tasks finishes. Every task runs as
+	/// a detached root task. The ones that lose are cancelled and left to finish on their
+	/// own and free their frames, their results are dropped.
+	template<typename T, typename Allocator>
+	class AnyAwaiter
+	{
+	public:
+		explicit AnyAwaiter(std::vector<Task<T, Allocator>>&& tasks) : tasks_(std::move(tasks))
+		{
+			if (tasks_.empty())
+				throw std::invalid_argument("when_any needs at least one task");
+		}
+
+		AnyAwaiter(const AnyAwaiter&) = delete;
+		AnyAwaiter& operator=(const AnyAwaiter&) = delete;
+
+		~AnyAwaiter()
+		{
+			if (state_ != nullptr)
+			{
+				state_->release();
+				return;
+			}
+
+			for (auto& task : tasks_)
+				task.handle.destroy();
+		}
+
+		constexpr bool await_ready() const noexcept { return false; }
+
+		void await_suspend(std::coroutine_handle<> handle)
+		{
+			auto waiter = PromiseBase::cast(handle);
+			Scheduler* scheduler = Scheduler::current();
+			State* state = new State(waiter, tasks_.size());
+			state_ = state;
+
+			std::vector<Task<void, Allocator>> drivers;
+			drivers.reserve(tasks_.size());
+
+			for (std::size_t i = 0; i < tasks_.size(); i++)
+			{
+				drivers.emplace_back(drive(std::move(tasks_[i]), state, i));
+				drivers.back().handle.promise().cancellation = state->source.token();
+			}
+
+			tasks_.clear();
+
+			// the first driver to finish may resume the waiter (and destroy us) from here on
+			scheduler->schedule(drivers, waiter.promise().priority);
+		}
+
+		/// The index of the winner, with its value unless T is void. Rethrows when the
+		/// first task to finish threw.
+		auto await_resume()
+		{
+			if (state_->exception)
+				std::rethrow_exception(state_->exception);
+
+			if constexpr (std::is_void_v<T>)
+				return state_->winner;
+			else
+				return AnyResult<T>{ state_->winner, std::move(*state_->value) };
+		}
+
+	private:
+		struct Empty {};
+
+		/// Shared by the awaiter and the drivers, the last one out deletes it. The tasks are
+		/// cancelled once one of them won or the waiter is cancelled.
+		struct State
+		{
+			State(std::coroutine_handle<PromiseBase> waiter, std::size_t drivers) :
+				waiter(waiter),
+				source(waiter.promise().cancellation),
+				refs(drivers + 1)
+			{}
+
+			/// True for the first caller only, who then fills in the result.
+			bool win() noexcept
+			{
+				return !settled.exchange(true, std::memory_order::acq_rel);
+			}
+
+			void release()
+			{
+				if (refs.fetch_sub(1, std::memory_order::acq_rel) == 1)
+					delete this;
+			}
+
+			std::coroutine_handle<PromiseBase> waiter;
+			CancellationSource source;
+			std::conditional_t<std::is_void_v<T>, Empty, std::optional<T>> value = {};
+			std::exception_ptr exception = nullptr;
+			std::size_t winner = 0;
+			std::atomic<bool> settled = false;
+			std::atomic<std::size_t> refs;
+		};
+
+		static Task<void, Allocator> drive(Task<T, Allocator> task, State* state, std::size_t index)
+		{
+			bool won = false;
+
+			try
+			{
+				if constexpr (std::is_void_v<T>)
+				{
+					co_await task;
+					won = state->win();
+				}
+				else
+				{
+					auto value = co_await task;
+					won = state->win();
+
+					if (won)
+						state->value.emplace(std::move(value));
+				}
+			}
+			catch (...)
+			{
+				won = state->win();
+
+				if (won)
+					state->exception = std::current_exception();
+			}
+
+			if (won)
+			{
+				state->winner = index;
+				state->source.cancel();
+				Scheduler::current()->schedule_awaiting(state->waiter);
+			}
+
+			state->release();
+		}
+
+		std::vector<Task<T, Allocator>> tasks_;
+		State* state_ = nullptr;
+	};
+
+	/// Waits for the first of the tasks to finish, e.g. hedged requests to replicas:
+	/// `auto [index, value] = co_await when_any(std::move(requests));`
+	/// For Task<void> only the index is returned.
+	template<typename T, typename Allocator>
+	[[nodiscard]] AnyAwaiter<T, Allocator> when_any(std::vector<Task<T, Allocator>>&& tasks)
+	{
+		return AnyAwaiter<T, Allocator>(std::move(tasks));
+	}
+
+	template<typename T, typename Allocator, typename... Ts>
+		requires (std::is_same_v<Ts, Task<T, Allocator>> && ...)
+	[[nodiscard]] AnyAwaiter<T, Allocator> when_any(Task<T, Allocator> task, Ts... tasks)
+	{
+		std::vector<Task<T, Allocator>> all;
+		all.reserve(sizeof...(Ts) + 1);
+		all.emplace_back(std::move(task));
+		(all.emplace_back(std::move(tasks)), ...);
+		return AnyAwaiter<T, Allocator>(std::move(all));
+	}
+
+	/// Runs `body(begin, end)` over the blocks of [0, count) on the workers, see
+	/// parallel_for(). The awaiting worker works through the blocks itself and only forks
+	/// the upper half of what is left off as a task while its deque is empty, i.e. while
+	/// nobody has anything of ours to steal (lazy binary splitting). A loop that finds
+	/// every worker busy costs no frame at all, one that does not a handful.
+	template<typename Body>
+	class ParallelAwaiter
+	{
+	public:
+		ParallelAwaiter(std::size_t count, std::size_t grain, Body body) :
+			body_(std::move(body)),
+			count_(count),
+			grain_(grain),
+			blocks_((count + grain - 1) / grain)
+		{}
+
+		ParallelAwaiter(const ParallelAwaiter&) = delete;
+		ParallelAwaiter& operator=(const ParallelAwaiter&) = delete;
+
+		bool await_ready() const noexcept
+		{
+			return count_ == 0;
+		}
+
+		/// Resumes right away when nothing was forked or the pieces are already done.
+		bool await_suspend(std::coroutine_handle<> handle)
+		{
+			waiter_ = PromiseBase::cast(handle);
+			scheduler_ = Scheduler::current();
+			pending_.store(1, std::memory_order::relaxed);
+
+			run(0, blocks_);
+			return pending_.fetch_sub(1, std::memory_order::acq_rel) != 1;
+		}
+
+		void await_resume() const
+		{
+			if (exception_)
+				std::rethrow_exception(exception_);
+
+			if (cancelled_.load(std::memory_order::relaxed))
+				throw OperationCancelled();
+		}
+
+	private:
+		void run(std::size_t first, std::size_t last)
+		{
+			const Priority priority = waiter_.promise().priority;
+			const CancellationToken& token = waiter_.promise().cancellation;
+
+			while (first < last)
+			{
+				while (last - first > 1 && scheduler_->should_split(priority))
+				{
+					const std::size_t middle = first + (last - first) / 2;
+					pending_.fetch_add(1, std::memory_order::relaxed);
+					scheduler_->fork(piece(this, middle, last).handle, priority);
+					last = middle;
+				}
+
+				if (failed_.load(std::memory_order::relaxed))
+					return;
+
+				if (token.cancelled())
+				{
+					cancelled_.store(true, std::memory_order::relaxed);
+					return;
+				}
+
+				try
+				{
+					body_(first * grain_, std::min(count_, (first + 1) * grain_));
+				}
+				catch (...)
+				{
+					// the first exception wins, the rest of the loop is skipped
+					if (!failed_.exchange(true, std::memory_order::acq_rel))
+						exception_ = std::current_exception();
+
+					return;
+				}
+
+				first++;
+			}
+		}
+
+		static Task<void> piece(ParallelAwaiter* self, std::size_t first, std::size_t last)
+		{
+			self->run(first, last);
+
+			// the waiter may be resumed (and destroy us) as soon as the count drops
+			if (self->pending_.fetch_sub(1, std::memory_order::acq_rel) == 1)
+				Scheduler::current()->schedule_awaiting(self->waiter_);
+
+			co_return;
+		}
+
+		Body body_;
+		const std::size_t count_;
+		const std::size_t grain_;
+		const std::size_t blocks_;
+		std::coroutine_handle<PromiseBase> waiter_ = nullptr;
+		Scheduler* scheduler_ = nullptr;
+		/// Pieces still running, including the waiter's own.
+		std::atomic<std::size_t> pending_ = 0;
+		std::atomic<bool> failed_ = false;
+		std::atomic<bool> cancelled_ = false;
+		std::exception_ptr exception_ = nullptr;
+	};
+
+	/// Elements per block when the caller leaves it to us: enough blocks for every worker
+	/// to get a few dozen, so the loop balances without checking for idle workers too
+	/// often.
+	[[nodiscard]] inline std::size_t parallel_grain(std::size_t count, std::size_t grain) noexcept
+	{
+		if (grain > 0)
+			return grain;
+
+		const Scheduler* scheduler = Scheduler::current();
+		const std::size_t workers = scheduler != nullptr ? scheduler->worker_count() : 1;
+		return std::max<std::size_t>(count / (workers * 32), 1);
+	}
+
+	/// Calls `fn(element)` for every element of [first, last) spread over the workers, in
+	/// no particular order. `grain` is the number of elements handled between checks for
+	/// idle workers, 0 picks one from the size of the range. Rethrows the first exception
+	/// thrown by `fn`, the elements not yet started are then skipped. For an index loop
+	/// pass `std::views::iota(std::size_t(0), count)`.
+	template<std::random_access_iterator It, typename Fn>
+	Task<void> parallel_for(It first, It last, Fn fn, std::size_t grain = 0)
+	{
+		const std::size_t count = static_cast<std::size_t>(last - first);
+
+		co_await ParallelAwaiter(count, parallel_grain(count, grain), [&](std::size_t begin, std::size_t end) {
+			for (It it = first + begin, stop = first + end; it != stop; ++it)
+				fn(*it);
+		});
+	}
+
+	template<std::ranges::random_access_range Range, typename Fn>
+		requires std::ranges::sized_range<Range>
+	Task<void> parallel_for(Range&& range, Fn fn, std::size_t grain = 0)
+	{
+		auto first = std::ranges::begin(range);
+		return parallel_for(first, first + std::ranges::distance(range), std::move(fn), grain);
+	}
+
+	/// Stores `fn(element)` for every element of [first, last) at the same position after
+	/// `out`, spread over the workers like parallel_for().
+	template<std::random_access_iterator It, std::random_access_iterator Out, typename Fn>
+	Task<void> parallel_transform(It first, It last, Out out, Fn fn, std::size_t grain = 0)
+	{
+		const std::size_t count = static_cast<std::size_t>(last - first);
+
+		co_await ParallelAwaiter(count, parallel_grain(count, grain), [&](std::size_t begin, std::size_t end) {
+			Out target = out + begin;
+
+			for (It it = first + begin, stop = first + end; it != stop; ++it, ++target)
+				*target = fn(*it);
+		});
+	}
+
+	template<std::ranges::random_access_range Range, std::random_access_iterator Out, typename Fn>
+		requires std::ranges::sized_range<Range>
+	Task<void> parallel_transform(Range&& range, Out out, Fn fn, std::size_t grain = 0)
+	{
+		auto first = std::ranges::begin(range);
+		return parallel_transform(first, first + std::ranges::distance(range), std::move(out), std::move(fn), grain);
+	}
+
+	/// Folds [first, last) into `init` with `op`, spread over the workers. Like
+	/// std::reduce `op` has to be associative, but the elements are combined in order so
+	/// it need not be commutative, and there is no identity element: every block starts
+	/// with its first element.
+	template<std::random_access_iterator It, typename T, typename Op>
+	Task<T> parallel_reduce(It first, It last, T init, Op op, std::size_t grain = 0)
+	{
+		const std::size_t count = static_cast<std::size_t>(last - first);
+		grain = parallel_grain(count, grain);
+
+		// one slot per block, each written by whoever runs the block
+		std::vector<std::optional<T>> partials((count + grain - 1) / grain);
+
+		co_await ParallelAwaiter(count, grain, [&](std::size_t begin, std::size_t end) {
+			It it = first + begin;
+			T value = *it;
+
+			for (const It stop = first + end; ++it != stop;)
+				value = op(std::move(value), *it);
+
+			partials[begin / grain].emplace(std::move(value));
+		});
+
+		for (auto& partial : partials)
+			init = op(std::move(init), std::move(*partial));
+
+		co_return init;
+	}
+
+	template<std::ranges::random_access_range Range, typename T, typename Op>
+		requires std::ranges::sized_range<Range>
+	Task<T> parallel_reduce(Range&& range, T init, Op op, std::size_t grain = 0)
+	{
+		auto first = std::ranges::begin(range);
+		return parallel_reduce(first, first + std::ranges::distance(range), std::move(init), std::move(op), grain);
+	}
+
+	template<typename T, typename Allocator>
+	Task<void> sync_result(Task<T, Allocator> task, std::optional<typename TaskResult<Task<T, Allocator>>::type>& result)
+	{
+		if constexpr (std::is_void_v<T>)
+		{
+			co_await std::move(task);
+			result.emplace();
+		}
+		else
+		{
+			result.emplace(co_await std::move(task));
+		}
+	}
+
+	/// Runs the task on the scheduler and blocks until it is done, for code that is no
+	/// coroutine itself: `auto sum = sync_wait(scheduler, parallel_reduce(data, 0.0, std::plus()));`
+	/// It drives the scheduler through run(), so it must not be called while run() is
+	/// active. Rethrows what the task threw.
+	template<typename T, typename Allocator>
+	auto sync_wait(Scheduler& scheduler, Task<T, Allocator> task)
+	{
+		std::optional<typename TaskResult<Task<T, Allocator>>::type> result;
+		auto root = sync_result(std::move(task), result);
+		scheduler.schedule(root);
+		scheduler.run();
+
+		if constexpr (!std::is_void_v<T>)
+			return std::move(*result);
+	}
+
+	/// A task suspended on one of the primitives below. Lives in the awaiter, i.e. in the
+	/// frame of the waiting task, so waiting allocates nothing.
+	struct AsyncWaiter
+	{
+		/// Waiters push themselves onto a stack, newest first. Reversed it is the order
+		/// they arrived in.
+		[[nodiscard]] static AsyncWaiter* reverse(AsyncWaiter* stack) noexcept
+		{
+			AsyncWaiter* list = nullptr;
+
+			while (stack != nullptr)
+				list = std::exchange(stack, std::exchange(stack->next, list));
+
+			return list;
+		}
+
+		/// Queues the task on the scheduler it was suspended on, so wakers may run on any
+		/// thread. The waiter may be gone as soon as this returns.
+		void resume() const
+		{
+			scheduler->schedule_awaiting(handle);
+		}
+
+		AsyncWaiter* next = nullptr;
+		std::coroutine_handle<PromiseBase> handle = nullptr;
+		Scheduler* scheduler = nullptr;
+	};
+
+	/// Mutual exclusion for tasks: a contended lock() suspends the task rather than the
+	/// worker. Locking and unlocking without contention is a single atomic operation
+	/// each. unlock() hands the mutex straight to the task that has waited longest, so
+	/// nobody can barge in ahead of it. Waiting does not observe cancellation.
+	///
+	///     auto lock = co_await mutex.scoped_lock();
+	class AsyncMutex
+	{
+	public:
+		/// Unlocks the mutex when destroyed, see scoped_lock().
+		class Lock
+		{
+		public:
+			Lock(AsyncMutex& mutex, std::adopt_lock_t) noexcept : mutex_(&mutex) {}
+
+			Lock(Lock&& other) noexcept : mutex_(std::exchange(other.mutex_, nullptr)) {}
+
+			Lock& operator=(Lock&& other) noexcept
+			{
+				if (this != &other)
+				{
+					unlock();
+					mutex_ = std::exchange(other.mutex_, nullptr);
+				}
+
+				return *this;
+			}
+
+			~Lock()
+			{
+				unlock();
+			}
+
+			/// Unlocks before the end of the scope, does nothing the second time.
+			void unlock()
+			{
+				if (mutex_ != nullptr)
+					std::exchange(mutex_, nullptr)->unlock();
+			}
+
+		private:
+			AsyncMutex* mutex_;
+		};
+
+		class LockAwaiter
+		{
+		public:
+			explicit LockAwaiter(AsyncMutex& mutex) noexcept : mutex_(mutex) {}
+
+			LockAwaiter(const LockAwaiter&) = delete;
+			LockAwaiter& operator=(const LockAwaiter&) = delete;
+
+			bool await_ready() noexcept
+			{
+				return mutex_.try_lock();
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle) noexcept
+			{
+				waiter_.handle = PromiseBase::cast(handle);
+				waiter_.scheduler = Scheduler::current();
+				void* state = mutex_.state_.load(std::memory_order::relaxed);
+
+				while (true)
+				{
+					if (state == &mutex_)
+					{
+						// unlocked in the meantime
+						if (mutex_.state_.compare_exchange_weak(state, nullptr, std::memory_order::acquire, std::memory_order::relaxed))
+							return false;
+					}
+					else
+					{
+						waiter_.next = static_cast<AsyncWaiter*>(state);
+
+						if (mutex_.state_.compare_exchange_weak(state, &waiter_, std::memory_order::release, std::memory_order::relaxed))
+							return true;
+					}
+				}
+			}
+
+			constexpr void await_resume() const noexcept {}
+
+		protected:
+			AsyncMutex& mutex_;
+			AsyncWaiter waiter_ = {};
+		};
+
+		class ScopedLockAwaiter : public LockAwaiter
+		{
+		public:
+			using LockAwaiter::LockAwaiter;
+
+			[[nodiscard]] Lock await_resume() const noexcept
+			{
+				return Lock(mutex_, std::adopt_lock);
+			}
+		};
+
+		AsyncMutex() noexcept : state_(this) {}
+
+		AsyncMutex(const AsyncMutex&) = delete;
+		AsyncMutex& operator=(const AsyncMutex&) = delete;
+
+		[[nodiscard]] bool try_lock() noexcept
+		{
+			void* state = this;
+			return state_.compare_exchange_strong(state, nullptr, std::memory_order::acquire, std::memory_order::relaxed);
+		}
+
+		/// `co_await mutex.lock();` the task has to call unlock() itself.
+		[[nodiscard]] LockAwaiter lock() noexcept
+		{
+			return LockAwaiter(*this);
+		}
+
+		/// `auto lock = co_await mutex.scoped_lock();` unlocked when `lock` goes out of scope.
+		[[nodiscard]] ScopedLockAwaiter scoped_lock() noexcept
+		{
+			return ScopedLockAwaiter(*this);
+		}
+
+		/// Passes the mutex on to the next waiting task, which is queued on its scheduler.
+		void unlock()
+		{
+			AsyncWaiter* next = waiters_;
+
+			if (next == nullptr)
+			{
+				void* state = nullptr;
+
+				if (state_.compare_exchange_strong(state, this, std::memory_order::release, std::memory_order::relaxed))
+					return;
+
+				// everyone who queued up since the last time, the mutex stays locked
+				next = AsyncWaiter::reverse(static_cast<AsyncWaiter*>(state_.exchange(nullptr, std::memory_order::acquire)));
+			}
+
+			waiters_ = next->next;
+			next->resume();
+		}
+
+	private:
+		/// `this` while unlocked, nullptr while locked and nobody queued up since the
+		/// holder last looked, otherwise the stack of tasks that did.
+		std::atomic<void*> state_;
+		/// Waiters taken off the stack in arrival order, only touched by the holder.
+		AsyncWaiter* waiters_ = nullptr;
+	};
+
+	/// Counting semaphore for tasks, e.g. to cap the reads in flight per disk. A task
+	/// that finds no permit left suspends until release() hands it one, in the order the
+	/// tasks arrived. Acquiring and releasing without contention is a single atomic
+	/// operation each, only tasks that have to wait take a lock. Waiting does not observe
+	/// cancellation.
+	///
+	///     auto permit = co_await disk.scoped_acquire();
+	class AsyncSemaphore
+	{
+	public:
+		/// Releases the permit when destroyed, see scoped_acquire().
+		class Permit
+		{
+		public:
+			explicit Permit(AsyncSemaphore& semaphore) noexcept : semaphore_(&semaphore) {}
+
+			Permit(Permit&& other) noexcept : semaphore_(std::exchange(other.semaphore_, nullptr)) {}
+
+			Permit& operator=(Permit&& other) noexcept
+			{
+				if (this != &other)
+				{
+					release();
+					semaphore_ = std::exchange(other.semaphore_, nullptr);
+				}
+
+				return *this;
+			}
+
+			~Permit()
+			{
+				release();
+			}
+
+			/// Releases before the end of the scope, does nothing the second time.
+			void release()
+			{
+				if (semaphore_ != nullptr)
+					std::exchange(semaphore_, nullptr)->release();
+			}
+
+		private:
+			AsyncSemaphore* semaphore_;
+		};
+
+		class AcquireAwaiter
+		{
+		public:
+			explicit AcquireAwaiter(AsyncSemaphore& semaphore) noexcept : semaphore_(semaphore) {}
+
+			AcquireAwaiter(const AcquireAwaiter&) = delete;
+			AcquireAwaiter& operator=(const AcquireAwaiter&) = delete;
+
+			/// Takes a permit or a place in line, both count against the semaphore.
+			bool await_ready() noexcept
+			{
+				return semaphore_.count_.fetch_sub(1, std::memory_order::acquire) > 0;
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle)
+			{
+				waiter_.handle = PromiseBase::cast(handle);
+				waiter_.scheduler = Scheduler::current();
+				std::scoped_lock lock(semaphore_.mutex_);
+
+				// a release() got here first and left its permit for us
+				if (semaphore_.handoffs_ > 0)
+				{
+					semaphore_.handoffs_--;
+					return false;
+				}
+
+				if (semaphore_.tail_ != nullptr)
+					semaphore_.tail_->next = &waiter_;
+				else
+					semaphore_.head_ = &waiter_;
+
+				semaphore_.tail_ = &waiter_;
+				return true;
+			}
+
+			constexpr void await_resume() const noexcept {}
+
+		protected:
+			AsyncSemaphore& semaphore_;
+			AsyncWaiter waiter_ = {};
+		};
+
+		class ScopedAcquireAwaiter : public AcquireAwaiter
+		{
+		public:
+			using AcquireAwaiter::AcquireAwaiter;
+
+			[[nodiscard]] Permit await_resume() const noexcept
+			{
+				return Permit(semaphore_);
+			}
+		};
+
+		explicit AsyncSemaphore(std::size_t permits) noexcept : count_(static_cast<std::ptrdiff_t>(permits)) {}
+
+		AsyncSemaphore(const AsyncSemaphore&) = delete;
+		AsyncSemaphore& operator=(const AsyncSemaphore&) = delete;
+
+		/// Never takes a permit while tasks are waiting for one.
+		[[nodiscard]] bool try_acquire() noexcept
+		{
+			std::ptrdiff_t count = count_.load(std::memory_order::relaxed);
+
+			while (count > 0)
+			{
+				if (count_.compare_exchange_weak(count, count - 1, std::memory_order::acquire, std::memory_order::relaxed))
+					return true;
+			}
+
+			return false;
+		}
+
+		/// `co_await semaphore.acquire();` the task has to call release() itself.
+		[[nodiscard]] AcquireAwaiter acquire() noexcept
+		{
+			return AcquireAwaiter(*this);
+		}
+
+		/// `auto permit = co_await semaphore.scoped_acquire();` released when `permit` goes
+		/// out of scope.
+		[[nodiscard]] ScopedAcquireAwaiter scoped_acquire() noexcept
+		{
+			return ScopedAcquireAwaiter(*this);
+		}
+
+		/// Hands the permits to waiting tasks first, those are queued on their schedulers.
+		void release(std::size_t permits = 1)
+		{
+			const std::ptrdiff_t count = count_.fetch_add(static_cast<std::ptrdiff_t>(permits), std::memory_order::release);
+
+			// a negative count is the number of tasks waiting or on their way to
+			if (count >= 0)
+				return;
+
+			std::size_t wakeups = std::min(permits, static_cast<std::size_t>(-count));
+			AsyncWaiter* woken = nullptr;
+			{
+				std::scoped_lock lock(mutex_);
+
+				for (; wakeups > 0 && head_ != nullptr; wakeups--)
+				{
+					AsyncWaiter* waiter = std::exchange(head_, head_->next);
+					waiter->next = woken;
+					woken = waiter;
+				}
+
+				if (head_ == nullptr)
+					tail_ = nullptr;
+
+				handoffs_ += wakeups;
+			}
+
+			for (AsyncWaiter* waiter = AsyncWaiter::reverse(woken); waiter != nullptr;)
+				std::exchange(waiter, waiter->next)->resume();
+		}
+
+		/// Permits left, negative while tasks are waiting. A snapshot only.
+		[[nodiscard]] std::ptrdiff_t available() const noexcept
+		{
+			return count_.load(std::memory_order::relaxed);
+		}
+
+	private:
+		std::atomic<std::ptrdiff_t> count_;
+		std::mutex mutex_;
+		/// Waiting tasks, oldest first.
+		AsyncWaiter* head_ = nullptr;
+		AsyncWaiter* tail_ = nullptr;
+		/// Permits released for tasks that counted themselves in but have not queued up yet.
+		std::size_t handoffs_ = 0;
+	};
+
+	/// Manual reset event: wait() suspends tasks until set() is called and returns right
+	/// away from then on until reset(). set() queues the waiting tasks on their
+	/// schedulers in the order they arrived. Any thread may set or reset the event,
+	/// waiting does not observe cancellation.
+	class AsyncEvent
+	{
+	public:
+		class WaitAwaiter
+		{
+		public:
+			explicit WaitAwaiter(AsyncEvent& event) noexcept : event_(event) {}
+
+			WaitAwaiter(const WaitAwaiter&) = delete;
+			WaitAwaiter& operator=(const WaitAwaiter&) = delete;
+
+			bool await_ready() const noexcept
+			{
+				return event_.is_set();
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle) noexcept
+			{
+				waiter_.handle = PromiseBase::cast(handle);
+				waiter_.scheduler = Scheduler::current();
+				void* state = event_.state_.load(std::memory_order::acquire);
+
+				do
+				{
+					if (state == &event_)
+						return false;
+
+					waiter_.next = static_cast<AsyncWaiter*>(state);
+				} while (!event_.state_.compare_exchange_weak(state, &waiter_, std::memory_order::acq_rel, std::memory_order::acquire));
+
+				return true;
+			}
+
+			constexpr void await_resume() const noexcept {}
+
+		private:
+			AsyncEvent& event_;
+			AsyncWaiter waiter_ = {};
+		};
+
+		explicit AsyncEvent(bool set = false) noexcept : state_(set ? this : nullptr) {}
+
+		AsyncEvent(const AsyncEvent&) = delete;
+		AsyncEvent& operator=(const AsyncEvent&) = delete;
+
+		[[nodiscard]] bool is_set() const noexcept
+		{
+			return state_.load(std::memory_order::acquire) == this;
+		}
+
+		[[nodiscard]] WaitAwaiter wait() noexcept
+		{
+			return WaitAwaiter(*this);
+		}
+
+		void set()
+		{
+			void* state = state_.exchange(this, std::memory_order::acq_rel);
+
+			if (state == this)
+				return;
+
+			for (AsyncWaiter* waiter = AsyncWaiter::reverse(static_cast<AsyncWaiter*>(state)); waiter != nullptr;)
+				std::exchange(waiter, waiter->next)->resume();
+		}
+
+		/// Does nothing unless the event is set, tasks already waiting keep waiting.
+		void reset() noexcept
+		{
+			void* state = this;
+			state_.compare_exchange_strong(state, nullptr, std::memory_order::relaxed);
+		}
+
+	private:
+		/// `this` while set, otherwise the stack of waiting tasks.
+		std::atomic<void*> state_;
+	};
+
+	/// Single use countdown like std::latch, but wait() suspends the task instead of the
+	/// thread. The count_down() that reaches zero queues the waiting tasks.
+	class Latch
+	{
+	public:
+		explicit Latch(std::size_t count) noexcept : count_(count), done_(count == 0) {}
+
+		Latch(const Latch&) = delete;
+		Latch& operator=(const Latch&) = delete;
+
+		void count_down(std::size_t n = 1)
+		{
+			if (count_.fetch_sub(n, std::memory_order::acq_rel) == n)
+				done_.set();
+		}
+
+		[[nodiscard]] bool try_wait() const noexcept
+		{
+			return done_.is_set();
+		}
+
+		[[nodiscard]] AsyncEvent::WaitAwaiter wait() noexcept
+		{
+			return done_.wait();
+		}
+
+		/// count_down() followed by wait(), for tasks meeting up at the end of a phase.
+		[[nodiscard]] AsyncEvent::WaitAwaiter arrive_and_wait(std::size_t n = 1)
+		{
+			count_down(n);
+			return done_.wait();
+		}
+
+	private:
+		std::atomic<std::size_t> count_;
+		AsyncEvent done_;
+	};
+
+	/// Bounded channel between tasks, e.g. the stages of a streaming pipeline. send()
+	/// suspends while the channel is full and recv() while it is empty, so a pipeline
+	/// runs in a fixed amount of memory without blocking a worker. The elements sit in
+	/// a ring of lockfree::Slots, two AsyncSemaphores count the free slots and the
+	/// elements and line the suspended senders and receivers up in arrival order.
+	/// A slot counts as free or as an element only once every slot before it does, so
+	/// whoever holds a permit finds its slot ready and never waits for another task.
+	///
+	///     while (auto item = co_await input.recv())
+	///     {
+	///         const bool sent = co_await output.send(transform(std::move(*item)));
+	///
+	///         if (!sent)
+	///             break;
+	///     }
+	///
+	/// Once closed, send() fails and recv() drains the elements that are left, then
+	/// returns an empty optional. The channel has to outlive the tasks using it.
+	/// T only has to be nothrow move constructible, the slots hold raw storage.
+	template<typename T>
+	class Channel
+	{
+	public:
+		class SendAwaiter : public AsyncSemaphore::AcquireAwaiter
+		{
+		public:
+			SendAwaiter(Channel& channel, T&& value) : AsyncSemaphore::AcquireAwaiter(channel.free_),
+				channel_(channel),
+				value_(std::move(value))
+			{}
+
+			/// False when the channel was closed, the value is dropped then.
+			[[nodiscard]] bool await_resume()
+			{
+				return channel_.push(std::move(value_));
+			}
+
+		private:
+			Channel& channel_;
+			T value_;
+		};
+
+		class RecvAwaiter : public AsyncSemaphore::AcquireAwaiter
+		{
+		public:
+			explicit RecvAwaiter(Channel& channel) noexcept : AsyncSemaphore::AcquireAwaiter(channel.items_),
+				channel_(channel)
+			{}
+
+			/// Empty once the channel is closed and drained.
+			[[nodiscard]] std::optional<T> await_resume()
+			{
+				return channel_.pop();
+			}
+
+		private:
+			Channel& channel_;
+		};
+
+		/// Throws std::invalid_argument for a capacity of 0.
+		explicit Channel(std::size_t capacity) :
+			slots_(capacity > 0 ? new lockfree::Slot<T>[capacity] : throw std::invalid_argument("capacity < 1")),
+			capacity_(capacity),
+			free_(capacity),
+			items_(0)
+		{}
+
+		Channel(const Channel&) = delete;
+		Channel& operator=(const Channel&) = delete;
+
+		/// `bool sent = co_await channel.send(value);`
+		[[nodiscard]] SendAwaiter send(T value)
+		{
+			return SendAwaiter(*this, std::move(value));
+		}
+
+		/// `std::optional<T> value = co_await channel.recv();`
+		[[nodiscard]] RecvAwaiter recv() noexcept
+		{
+			return RecvAwaiter(*this);
+		}
+
+		/// Never suspends, false when the channel is full or closed.
+		[[nodiscard]] bool try_send(T value)
+		{
+			return free_.try_acquire() && push(std::move(value));
+		}
+
+		/// Never suspends, empty when the channel is empty.
+		[[nodiscard]] std::optional<T> try_recv()
+		{
+			if (!items_.try_acquire())
+				return std::nullopt;
+
+			return pop();
+		}
+
+		/// Fails every following send() and resumes the suspended senders (theirs fail too)
+		/// and receivers (they drain the channel first). Only the first call does anything.
+		void close()
+		{
+			if (tail_.fetch_or(closed_bit, std::memory_order::acq_rel) & closed_bit)
+				return;
+
+			// nobody waits on either semaphore again
+			free_.release(flood);
+			items_.release(flood);
+		}
+
+		[[nodiscard]] bool closed() const noexcept
+		{
+			return (tail_.load(std::memory_order::acquire) & closed_bit) != 0;
+		}
+
+		/// Elements in the channel, a best effort guess while in use.
+		[[nodiscard]] std::size_t size() const noexcept
+		{
+			const std::uint64_t sent = sent_.load(std::memory_order::relaxed);
+			const std::uint64_t head = head_.load(std::memory_order::relaxed);
+			return sent > head ? static_cast<std::size_t>(sent - head) : 0;
+		}
+
+		[[nodiscard]] std::size_t capacity() const noexcept
+		{
+			return capacity_;
+		}
+
+	private:
+		static constexpr std::size_t flood = std::numeric_limits<std::ptrdiff_t>::max() / 2;
+		static constexpr std::uint64_t closed_bit = std::uint64_t(1) << 63;
+
+		/// A slot's turn is twice the lap of its position while free and one more while
+		/// it holds an element, as in lockfree::Queue.
+		[[nodiscard]] std::uint64_t turn(std::uint64_t position) const noexcept
+		{
+			return position / capacity_ * 2;
+		}
+
+		/// Called with a free slot acquired, that is the one at the next position.
+		bool push(T&& value)
+		{
+			std::uint64_t position = tail_.load(std::memory_order::relaxed);
+
+			// our permit may predate the receive that freed the slot, but a sender before
+			// us in line got one that came after it, the tail passes that on
+			do
+			{
+				if (position & closed_bit)
+					return false;
+			}
+			while (!tail_.compare_exchange_weak(position, position + 1, std::memory_order::acq_rel, std::memory_order::relaxed));
+
+			lockfree::Slot<T>& slot = slots_[position % capacity_];
+			slot.construct(std::move(value));
+			slot.turn.store(turn(position) + 1, std::memory_order::seq_cst);
+
+			count_done(sent_, 1, items_);
+			return true;
+		}
+
+		/// Called with an element acquired, or after close() when there may be none left.
+		std::optional<T> pop()
+		{
+			std::uint64_t position = head_.load(std::memory_order::relaxed);
+
+			do
+			{
+				if (position >= sent_.load(std::memory_order::acquire))
+					return std::nullopt;
+			}
+			while (!head_.compare_exchange_weak(position, position + 1, std::memory_order::relaxed));
+
+			lockfree::Slot<T>& slot = slots_[position % capacity_];
+			std::optional<T> value(slot.move());
+			slot.destroy();
+			slot.turn.store(turn(position) + 2, std::memory_order::seq_cst);
+
+			count_done(received_, 2, free_);
+			return value;
+		}
+
+		/// Moves `cursor` over the positions whose slot reached `turn(position) + step`
+		/// and releases a permit for each. Whoever finishes a slot moves the cursor over
+		/// the finished ones after it too, so a slow task only holds back the permits
+		/// behind its own slot. Both the turn and the cursor are seq_cst, so of two tasks
+		/// finishing neighbouring slots at once at least one sees the other's.
+		void count_done(std::atomic<std::uint64_t>& cursor, std::uint64_t step, AsyncSemaphore& permits)
+		{
+			std::uint64_t position = cursor.load(std::memory_order::seq_cst);
+			std::size_t count = 0;
+
+			while (slots_[position % capacity_].turn.load(std::memory_order::seq_cst) == turn(position) + step)
+			{
+				if (cursor.compare_exchange_strong(position, position + 1, std::memory_order::seq_cst))
+				{
+					position++;
+					count++;
+				}
+			}
+
+			if (count > 0)
+				permits.release(count);
+		}
+
+		const std::unique_ptr<lockfree::Slot<T>[]> slots_;
+		const std::size_t capacity_;
+		/// Next position to send to, with closed_bit set once closed.
+		alignas(lockfree::hardwareInterferenceSize) std::atomic<std::uint64_t> tail_ = 0;
+		/// Next position to receive from.
+		alignas(lockfree::hardwareInterferenceSize) std::atomic<std::uint64_t> head_ = 0;
+		/// Positions before it hold an element, counted by items_.
+		alignas(lockfree::hardwareInterferenceSize) std::atomic<std::uint64_t> sent_ = 0;
+		/// Positions before it are free again, counted by free_.
+		alignas(lockfree::hardwareInterferenceSize) std::atomic<std::uint64_t> received_ = 0;
+		AsyncSemaphore free_;
+		AsyncSemaphore items_;
+	};
+
+	/// Lazy sequence produced with co_yield, consumed with a range-for on the calling
+	/// thread. The body cannot co_await, see AsyncGenerator for that.
+	/// Yielded objects are handed out by reference and stay valid until the next element
+	/// is requested, only yielding a const lvalue makes a copy.
+	template<typename T, typename Allocator = DefaultAllocator>
+	class Generator
+	{
+	public:
+		using value_type = std::remove_cvref_t<T>;
+
+		struct promise_type
+		{
+			[[nodiscard]] static void* operator new(std::size_t size)
+			{
+				return Allocator::alloc(size);
+			}
+
+			static void operator delete(void* ptr)
+			{
+				Allocator::free(ptr);
+			}
+
+			[[nodiscard]] Generator get_return_object() noexcept { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+			constexpr std::suspend_always initial_suspend() const noexcept { return {}; }
+			constexpr std::suspend_always final_suspend() const noexcept { return {}; }
+
+			std::suspend_always yield_value(value_type& val) noexcept
+			{
+				value = std::addressof(val);
+				return {};
+			}
+
+			// the temporary lives until the generator is resumed
+			std::suspend_always yield_value(value_type&& val) noexcept
+			{
+				value = std::addressof(val);
+				return {};
+			}
+
+			std::suspend_always yield_value(const value_type& val)
+			{
+				copy.emplace(val);
+				value = std::addressof(*copy);
+				return {};
+			}
+
+			constexpr void return_void() const noexcept {}
+
+			void unhandled_exception()
+			{
+				exception = std::current_exception();
+			}
+
+			value_type* value = nullptr;
+			std::optional<value_type> copy;
+			std::exception_ptr exception = nullptr;
+		};
+
+		using Handle = std::coroutine_handle<promise_type>;
+
+		class iterator
+		{
+		public:
+			using value_type = Generator::value_type;
+			using difference_type = std::ptrdiff_t;
+
+			iterator() noexcept = default;
+			explicit iterator(Handle handle) noexcept : handle_(handle) {}
+
+			[[nodiscard]] value_type& operator*() const noexcept { return *handle_.promise().value; }
+			[[nodiscard]] value_type* operator->() const noexcept { return handle_.promise().value; }
+
+			iterator& operator++()
+			{
+				advance(handle_);
+				return *this;
+			}
+
+			void operator++(int) { ++*this; }
+
+			[[nodiscard]] bool operator==(std::default_sentinel_t) const noexcept { return handle_ == nullptr || handle_.done(); }
+
+		private:
+			Handle handle_ = nullptr;
+		};
+
+		Generator(Handle handle) : handle(handle) {}
+		Generator(const Generator&) = delete;
+		Generator(Generator&& generator) noexcept : handle(std::exchange(generator.handle, nullptr)) {}
+
+		~Generator()
+		{
+			if (handle)
+				handle.destroy();
+		}
+
+		/// Runs the body up to the first co_yield.
+		[[nodiscard]] iterator begin()
+		{
+			advance(handle);
+			return iterator(handle);
+		}
+
+		[[nodiscard]] std::default_sentinel_t end() const noexcept { return {}; }
+
+		Handle handle;
+
+	private:
+		static void advance(Handle handle)
+		{
+			handle.promise().copy.reset();
+			handle.resume();
+
+			if (handle.promise().exception)
+				std::rethrow_exception(std::exchange(handle.promise().exception, nullptr));
+		}
+	};
+
+	/// Lazy sequence whose body may co_await tasks and I/O, consumed one element at a
+	/// time from a coroutine running on the scheduler:
+	///
+	///     while (auto* record = co_await records.next())
+	///         consume(*record);
+	///
+	/// next() runs the body on the awaiting thread until it yields, and the co_yield
+	/// hands the thread straight back. The pointer stays valid until the next call to
+	/// next() and is null once the body returned. Exceptions from the body are rethrown
+	/// from next().
+	template<typename T, typename Allocator = DefaultAllocator>
+	class AsyncGenerator
+	{
+	public:
+		using value_type = std::remove_cvref_t<T>;
+
+		struct promise_type : public PromiseBase
+		{
+			[[nodiscard]] static void* operator new(std::size_t size)
+			{
+				return Allocator::alloc(size);
+			}
+
+			static void operator delete(void* ptr)
+			{
+				Allocator::free(ptr);
+			}
+
+			[[nodiscard]] AsyncGenerator get_return_object() noexcept { return AsyncGenerator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+			/// Suspends the body and resumes whoever called next().
+			struct YieldAwaiter
+			{
+				constexpr bool await_ready() const noexcept { return false; }
+
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) const noexcept
+				{
+					return handle.promise().awaiting_coro;
+				}
+
+				constexpr void await_resume() const noexcept {}
+			};
+
+			YieldAwaiter final_suspend() noexcept
+			{
+				value = nullptr;
+				return {};
+			}
+
+			YieldAwaiter yield_value(value_type& val) noexcept
+			{
+				value = std::addressof(val);
+				return {};
+			}
+
+			// the temporary lives until the generator is resumed
+			YieldAwaiter yield_value(value_type&& val) noexcept
+			{
+				value = std::addressof(val);
+				return {};
+			}
+
+			YieldAwaiter yield_value(const value_type& val)
+			{
+				copy.emplace(val);
+				value = std::addressof(*copy);
+				return {};
+			}
+
+			constexpr void return_void() const noexcept {}
+
+			value_type* value = nullptr;
+			std::optional<value_type> copy;
+		};
+
+		using Handle = std::coroutine_handle<promise_type>;
+
+		AsyncGenerator(Handle handle) : handle(handle) {}
+		AsyncGenerator(const AsyncGenerator&) = delete;
+		AsyncGenerator(AsyncGenerator&& generator) noexcept : handle(std::exchange(generator.handle, nullptr)) {}
+
+		~AsyncGenerator()
+		{
+			if (handle)
+				handle.destroy();
+		}
+
+		[[nodiscard]] auto next() noexcept
+		{
+			struct Awaiter
+			{
+				bool await_ready() const noexcept { return coro.done(); }
+
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting_handle) noexcept
+				{
+					auto handle = PromiseBase::cast(awaiting_handle);
+					auto& promise = coro.promise();
+
+					promise.copy.reset();
+					promise.awaiting_coro = handle;
+					handle.promise().inherit(promise);
+					return coro;
+				}
+
+				[[nodiscard]] value_type* await_resume() const
+				{
+					auto& promise = coro.promise();
+
+					if (promise.exception)
+						std::rethrow_exception(std::exchange(promise.exception, nullptr));
+
+					return coro.done() ? nullptr : promise.value;
+				}
+
+				Handle coro;
+			};
+
+			return Awaiter{ handle };
+		}
+
+		Handle handle;
+	};
+
+	/// Hands out fixed size buffers and keeps released ones around for reuse.
+	/// Must outlive everything that holds one of its buffers, which is why FileReader
+	/// shares the ownership of its pool.
+	class BufferPool
+	{
+	public:
+		explicit BufferPool(std::size_t buffer_size = 1024 * 1024) : buffer_size_(buffer_size) {}
+
+		~BufferPool()
+		{
+			for (char* buffer : free_)
+				::operator delete(buffer, std::align_val_t(alignment));
+		}
+
+		// non-copyable and non-movable
+		BufferPool(const BufferPool&) = delete;
+		BufferPool& operator=(const BufferPool&) = delete;
+
+		[[nodiscard]] char* acquire()
+		{
+			{
+				std::scoped_lock lock(mutex_);
+
+				if (!free_.empty())
+				{
+					char* buffer = free_.back();
+					free_.pop_back();
+					return buffer;
+				}
+			}
+
+			return static_cast<char*>(::operator new(buffer_size_, std::align_val_t(alignment)));
+		}
+
+		void release(char* buffer)
+		{
+			std::scoped_lock lock(mutex_);
+			free_.push_back(buffer);
+		}
+
+		[[nodiscard]] std::size_t buffer_size() const noexcept { return buffer_size_; }
+
+	private:
+		/// Page aligned, so buffers can be used for direct I/O.
+		static constexpr std::size_t alignment = 4096;
+
+		const std::size_t buffer_size_;
+		std::mutex mutex_;
+		std::vector<char*> free_ = {};
+	};
+
+#ifdef _WIN32
+	void WINAPI onFileRead(
+		_In_    DWORD dwErrorCode,
+		_In_    DWORD dwNumberOfBytesTransfered,
+		_Inout_ LPOVERLAPPED lpOverlapped
+	);
+
+	struct ReadFileAwaiter : public OVERLAPPED
+	{
+		ReadFileAwaiter(const std::string& path) : OVERLAPPED(),
+			data_()
+		{
+			fileHandle_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, NULL);
+
+			if (fileHandle_ == INVALID_HANDLE_VALUE)
+				throw std::runtime_error("Could not create file handle!");
+		}
+
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+
+		std::string await_resume() const
+		{
+			return std::move(data_);
+		}
+
+		void await_suspend(std::coroutine_handle<> handle)
+		{
+			handle_ = tasky::PromiseBase::cast(handle);
+			scheduler_ = Scheduler::current();
+
+			LARGE_INTEGER fileSize = {};
+
+			if (!GetFileSizeEx(fileHandle_, &fileSize))
+				throw std::runtime_error("Could not get file size!");
+
+			// a single ReadFile can't go past 4 GiB
+			if (fileSize.QuadPart > MAXDWORD)
+				throw std::runtime_error("File is too large to read at once!");
+
+			DWORD fileSizeLow = static_cast<DWORD>(fileSize.QuadPart);
+
+			data_.resize(fileSizeLow);
+
+			if (!BindIoCompletionCallback(fileHandle_, onFileRead, 0))
+				throw std::runtime_error("Could not bind IO completion callback!");
+
+			if (!ReadFile(fileHandle_, data_.data(), fileSizeLow, &read_, this))
+			{
+				const int err = GetLastError();
+				if (err != 997)
+					throw std::runtime_error("Could not read file!");
+
+			}
+		}
+
+	private:
+		DWORD read_ = 0;
+		std::string data_;
+		void* fileHandle_ = nullptr;
+		std::coroutine_handle<tasky::PromiseBase> handle_ = nullptr;
+		// the completion runs on a thread of the system pool
+		Scheduler* scheduler_ = nullptr;
+
+		friend void WINAPI onFileRead(
+			_In_    DWORD dwErrorCode,
+			_In_    DWORD dwNumberOfBytesTransfered,
+			_Inout_ LPOVERLAPPED lpOverlapped
+		);
+	};
+
+	void WINAPI onFileRead(
+		_In_    DWORD dwErrorCode,
+		_In_    DWORD dwNumberOfBytesTransfered,
+		_Inout_ LPOVERLAPPED lpOverlapped
+	)
+	{
+		auto* s = static_cast<ReadFileAwaiter*>(lpOverlapped);
+
+		if (!CloseHandle(s->fileHandle_))
+			throw std::runtime_error("Could not close file handle!");
+
+		s->scheduler_->schedule_awaiting(s->handle_);
+	}
+
+	void WINAPI onFileWrite(
+		_In_    DWORD dwErrorCode,
+		_In_    DWORD dwNumberOfBytesTransfered,
+		_Inout_ LPOVERLAPPED lpOverlapped
+	);
+
+	struct WriteFileAwaiter : public OVERLAPPED
+	{
+		WriteFileAwaiter(const std::string& path, const std::string& data) : OVERLAPPED(),
+			data_(data)
+		{
+			fileHandle_ = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, NULL);
+
+			if (fileHandle_ == INVALID_HANDLE_VALUE)
+				throw std::runtime_error("Could not create file handle!");
+		}
+
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+
+		void await_resume() const {}
+
+		void await_suspend(std::coroutine_handle<> handle)
+		{
+			handle_ = tasky::PromiseBase::cast(handle);
+			scheduler_ = Scheduler::current();
+
+			if (!BindIoCompletionCallback(fileHandle_, onFileWrite, 0))
+				throw std::runtime_error("Could not bind IO completion callback!");
+
+			DWORD s = static_cast<DWORD>(data_.size());
+
+			if (!WriteFile(fileHandle_, data_.data(), s, &written_, this))
+			{
+				const int err = GetLastError();
+				if (err != 997)
+					throw std::runtime_error("Could not write file!");
+			}
+		}
+
+	private:
+		DWORD written_ = 0;
+		const std::string& data_;
+		void* fileHandle_ = nullptr;
+		std::coroutine_handle<tasky::PromiseBase> handle_ = nullptr;
+		// the completion runs on a thread of the system pool
+		Scheduler* scheduler_ = nullptr;
+
+		friend void WINAPI onFileWrite(
+			_In_    DWORD dwErrorCode,
+			_In_    DWORD dwNumberOfBytesTransfered,
+			_Inout_ LPOVERLAPPED lpOverlapped
+		);
+	};
+
+	void WINAPI onFileWrite(
+		_In_    DWORD dwErrorCode,
+		_In_    DWORD dwNumberOfBytesTransfered,
+		_Inout_ LPOVERLAPPED lpOverlapped
+	)
+	{
+		auto* s = static_cast<WriteFileAwaiter*>(lpOverlapped);
+
+		if (!CloseHandle(s->fileHandle_))
+			throw std::runtime_error("Could not close file handle!");
+
+		s->scheduler_->schedule_awaiting(s->handle_);
+	}
+
+#elif defined(__linux__)
+	/// Cancels an io::Request when the task waiting for it is cancelled. Armed before the
+	/// request is first submitted and disarmed once the task resumes, which waits for a
+	/// cancellation running on another thread, so the request is alive while it runs.
+	struct RequestCanceller : public CancellationCallback
+	{
+		RequestCanceller() = default;
+
+		RequestCanceller(const RequestCanceller&) = delete;
+		RequestCanceller& operator=(const RequestCanceller&) = delete;
+
+		~RequestCanceller()
+		{
+			disarm();
+		}
+
+		void arm(std::coroutine_handle<PromiseBase> handle, io::Request& target)
+		{
+			scheduler = Scheduler::current();
+			request = &target;
+			token = &handle.promise().cancellation;
+			function = onCancelled;
+
+			if (!token->add(*this))
+				onCancelled(*this);
+		}
+
+		void disarm()
+		{
+			if (token != nullptr)
+				token->remove(*this);
+
+			token = nullptr;
+		}
+
+	private:
+		static void onCancelled(CancellationCallback& callback)
+		{
+			auto& c = static_cast<RequestCanceller&>(callback);
+			c.scheduler->reactor().cancel(*c.request);
+		}
+
+		Scheduler* scheduler = nullptr;
+		io::Request* request = nullptr;
+		const CancellationToken* token = nullptr;
+	};
+
+	struct ReadFileAwaiter : public io::Request
+	{
+		ReadFileAwaiter(const std::string& path) : io::Request(),
+			data_()
+		{
+			fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+			if (fd < 0)
+				throw std::runtime_error("Could not open file!");
+		}
+
+		ReadFileAwaiter(const ReadFileAwaiter&) = delete;
+		ReadFileAwaiter& operator=(const ReadFileAwaiter&) = delete;
+
+		~ReadFileAwaiter()
+		{
+			::close(fd);
+		}
+
+		bool await_ready() const noexcept
+		{
+			return false;
+		}
+
+		std::string await_resume()
+		{
+			canceller_.disarm();
+
+			if (error_ == ECANCELED)
+				throw OperationCancelled();
+
+			if (error_ != 0)
+				throw std::runtime_error("Could not read file!");
+
+			data_.resize(read_);
+			return std::move(data_);
+		}
+
+		bool await_suspend(std::coroutine_handle<> handle)
+		{
+			handle_ = tasky::PromiseBase::cast(handle);
+
+			struct stat info = {};
+
+			if (::fstat(fd, &info) < 0)
+				throw std::runtime_error("Could not get file size!");
+
+			data_.resize(static_cast<std::size_t>(info.st_size));
+
+			if (data_.empty())
+				return false;
+
+			callback = onFileRead;
+			op = Op::read;
+			buffer = data_.data();
+			length = data_.size();
+			offset = 0;
+			canceller_.arm(handle_, *this);
+			Scheduler::current()->submit(*this);
+			return true;
+		}
+
+	private:
+		static void onFileRead(io::Request& request, std::int64_t result)
+		{
+			auto& s = static_cast<ReadFileAwaiter&>(request);
+
+			if (result < 0)
+			{
+				s.error_ = static_cast<int>(-result);
+			}
+			else if (result > 0 && s.read_ + static_cast<std::size_t>(result) < s.data_.size())
+			{
+				// short read, ask for the rest
+				s.read_ += static_cast<std::size_t>(result);
+				s.buffer = s.data_.data() + s.read_;
+				s.length = s.data_.size() - s.read_;
+				s.offset = s.read_;
+				Scheduler::current()->submit(s);
+				return;
+			}
+			else
+			{
+				s.read_ += static_cast<std::size_t>(result);
+			}
+
+			Scheduler::current()->schedule_awaiting(s.handle_);
+		}
+
+		std::size_t read_ = 0;
+		int error_ = 0;
+		std::string data_;
+		std::coroutine_handle<tasky::PromiseBase> handle_ = nullptr;
+		RequestCanceller canceller_;
+	};
+
+	struct WriteFileAwaiter : public io::Request
+	{
+		WriteFileAwaiter(const std::string& path, const std::string& data) : io::Request(),
+			data_(data)
+		{
+			fd = ::open(path.c_str(), O_WRONLY | O_CLOEXEC);
+
+			if (fd < 0)
+				throw std::runtime_error("Could not open file!");
+		}
+
+		WriteFileAwaiter(const WriteFileAwaiter&) = delete;
+		WriteFileAwaiter& operator=(const WriteFileAwaiter&) = delete;
+
+		~WriteFileAwaiter()
+		{
+			::close(fd);
+		}
+
+		bool await_ready() const noexcept
+		{
+			return data_.empty();
+		}
+
+		void await_resume()
+		{
+			canceller_.disarm();
+
+			if (error_ == ECANCELED)
+				throw OperationCancelled();
+
+			if (error_ != 0)
+				throw std::runtime_error("Could not write file!");
+		}
+
+		void await_suspend(std::coroutine_handle<> handle)
+		{
+			handle_ = tasky::PromiseBase::cast(handle);
+
+			callback = onFileWrite;
+			op = Op::write;
+			buffer = const_cast<char*>(data_.data());
+			length = data_.size();
+			offset = 0;
+			canceller_.arm(handle_, *this);
+			Scheduler::current()->submit(*this);
+		}
+
+	private:
+		static void onFileWrite(io::Request& request, std::int64_t result)
+		{
+			auto& s = static_cast<WriteFileAwaiter&>(request);
+
+			if (result < 0)
+			{
+				s.error_ = static_cast<int>(-result);
+			}
+			else if (result > 0 && s.written_ + static_cast<std::size_t>(result) < s.data_.size())
+			{
+				// short write, hand over the rest
+				s.written_ += static_cast<std::size_t>(result);
+				s.buffer = const_cast<char*>(s.data_.data()) + s.written_;
+				s.length = s.data_.size() - s.written_;
+				s.offset = s.written_;
+				Scheduler::current()->submit(s);
+				return;
+			}
+
+			Scheduler::current()->schedule_awaiting(s.handle_);
+		}
+
+		std::size_t written_ = 0;
+		int error_ = 0;
+		const std::string& data_;
+		std::coroutine_handle<tasky::PromiseBase> handle_ = nullptr;
+		RequestCanceller canceller_;
+	};
+
+	/// Streams a file in chunks of the pool's buffer size while keeping `read_ahead`
+	/// reads in flight, so memory use does not depend on the size of the file.
+	///
+	///     FileReader reader(path, pool);
+	///     while (auto chunk = co_await reader.next())
+	///         consume(chunk->data);
+	///
+	/// A chunk stays valid until the following call to next(). The reader may be
+	/// destroyed with reads in flight, they are cancelled and their buffers go back to
+	/// the pool once the kernel is done with them. Until then the reads keep the pool
+	/// alive and count as running tasks, so run() does not return before.
+	class FileReader
+	{
+	public:
+		struct Chunk
+		{
+			std::uint64_t offset;
+			std::string_view data;
+		};
+
+		FileReader(const std::string& path, std::shared_ptr<BufferPool> pool, std::size_t read_ahead = 4) :
+			state_(new State(std::move(pool), std::max<std::size_t>(read_ahead, 1)))
+		{
+			state_->fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+			struct stat info = {};
+
+			if (state_->fd < 0 || ::fstat(state_->fd, &info) < 0)
+			{
+				delete state_;
+				throw std::runtime_error("Could not open file!");
+			}
+
+			state_->size = static_cast<std::uint64_t>(info.st_size);
+			const std::uint64_t chunk_size = state_->pool->buffer_size();
+			chunk_count_ = (state_->size + chunk_size - 1) / chunk_size;
+		}
+
+		FileReader(const FileReader&) = delete;
+		FileReader& operator=(const FileReader&) = delete;
+
+		~FileReader()
+		{
+			state_->abandoned.store(true, std::memory_order::release);
+
+			if (started_)
+				cancel_reads();
+
+			state_->release();
+		}
+
+		[[nodiscard]] std::uint64_t size() const noexcept { return state_->size; }
+
+		/// Throws OperationCancelled once the awaiting task is cancelled, then and on every
+		/// later call, the reads ahead are cancelled with it.
+		[[nodiscard]] auto next() noexcept
+		{
+			struct Awaiter
+			{
+				bool await_ready() const noexcept { return reader.cancelled_; }
+
+				// advancing here rather than in await_ready() sees the token on every call,
+				// a chunk that is read already comes back without suspending either way
+				bool await_suspend(std::coroutine_handle<> handle)
+				{
+					auto awaiting = PromiseBase::cast(handle);
+
+					if (awaiting.promise().cancellation.cancelled())
+					{
+						reader.cancel();
+						return false;
+					}
+
+					if (!reader.started_)
+						reader.start(Scheduler::current());
+					else
+						reader.advance();
+
+					if (reader.current_ >= reader.chunk_count_)
+						return false;
+
+					Slot& slot = reader.slot();
+
+					if (slot.status.load(std::memory_order::acquire) == Slot::done)
+						return false;
 
-				constexpr void await_resume() const
-				{
-					if (coro.promise().exception)
-						std::rethrow_exception(coro.promise().exception);
+					slot.waiter = awaiting;
+					canceller.arm(awaiting, slot);
+
+					// the read may have finished in the meantime
+					return slot.status.exchange(Slot::waiting, std::memory_order::acq_rel) != Slot::done;
 				}
 
-				void await_suspend(std::coroutine_handle<> awaiting_handle)
+				std::optional<Chunk> await_resume()
 				{
-					auto handle = PromiseBase::cast(awaiting_handle);
-					auto& promise = handle.promise();
+					canceller.disarm();
 
-					coro.promise().awaiting_coro = handle;
-					promise.awaiting_count.store(1, std::memory_order::release);
-					promise.scheduler->schedule(coro);
-				}
+					if (reader.cancelled_)
+						throw OperationCancelled();
 
-				std::coroutine_handle<promise_type> coro;
+					if (reader.current_ >= reader.chunk_count_)
+						return std::nullopt;
 
-				Awaiter(std::coroutine_handle<promise_type> coro) noexcept : coro(coro) {}
-				~Awaiter() { coro.destroy(); }
+					const Slot& slot = reader.slot();
+
+					if (slot.error == ECANCELED)
+					{
+						reader.cancel();
+						throw OperationCancelled();
+					}
+
+					if (slot.error != 0)
+						throw std::runtime_error("Could not read file!");
+
+					return Chunk{ slot.start, std::string_view(slot.data, slot.filled) };
+				}
+
+				FileReader& reader;
+				RequestCanceller canceller = {};
 			};
 
-			return Awaiter(handle);
+			return Awaiter{ *this };
 		}
 
-		Handle handle;
-	};
-
-	template<typename T, typename Allocator = DefaultAllocator>
-	struct MultipleAwaiter
-	{
-		constexpr bool await_ready() const noexcept { return false; }
+	private:
+		struct State;
 
-		[[nodiscard]] constexpr std::vector<T> await_resume() const
+		struct Slot : public io::Request
 		{
-			std::vector<T> results;
-			for (auto& coro : coros)
-			{
-				using P = Task<T, Allocator>::promise_type;
-				auto x = std::coroutine_handle<P>::from_address(coro.address());
-				auto& p = x.promise();
+			static constexpr int in_flight = 0;
+			static constexpr int waiting = 1;
+			static constexpr int done = 2;
 
-				if (p.exception)
-					std::rethrow_exception(p.exception);
-
-				results.emplace_back(p.value.value());
-			}
-			return results;
-		}
+			State* state = nullptr;
+			char* data = nullptr;
+			std::uint64_t start = 0;
+			std::size_t filled = 0;
+			std::size_t wanted = 0;
+			int error = 0;
+			std::atomic<int> status = in_flight;
+			std::coroutine_handle<PromiseBase> waiter = nullptr;
+		};
 
-		void await_suspend(std::coroutine_handle<> awaiting_handle)
+		/// Shared between the reader and its in flight reads, the last one out deletes it.
+		struct State
 		{
-			auto handle = PromiseBase::cast(awaiting_handle);
+			State(std::shared_ptr<BufferPool> pool, std::size_t read_ahead) : pool(std::move(pool)), slot_count(read_ahead), slots(new Slot[read_ahead]) {}
 
-			auto& promise = handle.promise();
-			Scheduler* scheduler = promise.scheduler;
-			promise.awaiting_count.store(coros.size(), std::memory_order::release);
+			~State()
+			{
+				for (std::size_t i = 0; i < slot_count; i++)
+				{
+					if (slots[i].data != nullptr)
+						pool->release(slots[i].data);
+				}
 
-			for (auto& coro : coros)
+				if (fd >= 0)
+					::close(fd);
+			}
+
+			void release()
 			{
-				coro.promise().awaiting_coro = handle;
-				scheduler->schedule(coro);
+				if (refs.fetch_sub(1, std::memory_order::acq_rel) == 1)
+					delete this;
 			}
-		}
 
-		MultipleAwaiter(std::initializer_list<Task<T, Allocator>> tasks) : coros()
-		{
-			for (auto& coro : tasks)
-				coros.emplace_back(PromiseBase::cast(coro.handle));
-		}
+			std::shared_ptr<BufferPool> pool;
+			const std::size_t slot_count;
+			std::unique_ptr<Slot[]> slots;
+			int fd = -1;
+			std::uint64_t size = 0;
+			Scheduler* scheduler = nullptr;
+			std::atomic<std::size_t> refs = 1;
+			std::atomic<bool> abandoned = false;
+		};
 
-		MultipleAwaiter(std::vector<Task<T, Allocator>>&& tasks) : coros()
+		Slot& slot() const noexcept { return state_->slots[current_ % state_->slot_count]; }
+
+		void start(Scheduler* scheduler)
 		{
-			for (auto& coro : tasks)
-				coros.emplace_back(PromiseBase::cast(coro.handle));
+			started_ = true;
+			state_->scheduler = scheduler;
+
+			for (std::uint64_t i = 0; i < std::min<std::uint64_t>(state_->slot_count, chunk_count_); i++)
+				submit(state_->slots[i], i);
 		}
 
-		~MultipleAwaiter()
+		/// Hands the slot of the chunk returned last back to the kernel for the chunk
+		/// `read_ahead` positions further.
+		void advance()
 		{
-			for (auto& coro : coros)
-				coro.destroy();
+			Slot& previous = slot();
+			const std::uint64_t index = current_ + state_->slot_count;
+			current_++;
+
+			if (index < chunk_count_)
+				submit(previous, index);
 		}
 
-		std::vector<std::coroutine_handle<PromiseBase>> coros;
-	};
+		/// Stops the reader for good, the reads ahead are of no use to anyone now.
+		void cancel()
+		{
+			cancelled_ = true;
 
-	template<typename Allocator>
-	struct MultipleAwaiter<void, Allocator>
-	{
-		[[nodiscard]] constexpr bool await_ready() const noexcept { return false; }
+			if (started_)
+				cancel_reads();
+		}
 
-		constexpr void await_resume() const
+		/// Asks the reactor to stop the reads still in flight, they complete with
+		/// -ECANCELED unless the kernel is done with them already.
+		void cancel_reads()
 		{
-			for (auto& coro : coros)
+			for (std::size_t i = 0; i < state_->slot_count; i++)
 			{
-				auto& promise = PromiseBase::cast(coro).promise();
+				Slot& slot = state_->slots[i];
 
-				if (promise.exception)
-					std::rethrow_exception(promise.exception);
+				if (slot.state != nullptr && slot.status.load(std::memory_order::acquire) != Slot::done)
+					state_->scheduler->reactor().cancel(slot);
 			}
 		}
 
-		void await_suspend(std::coroutine_handle<> awaiting_handle)
+		void submit(Slot& slot, std::uint64_t index)
 		{
-			auto handle = PromiseBase::cast(awaiting_handle);
+			const std::uint64_t chunk_size = state_->pool->buffer_size();
 
-			auto& promise = handle.promise();
-			Scheduler* scheduler = promise.scheduler;
-			promise.awaiting_count.store(coros.size(), std::memory_order::release);
+			if (slot.data == nullptr)
+				slot.data = state_->pool->acquire();
 
-			for (auto& coro : coros)
-			{
-				coro.promise().awaiting_coro = handle;
-				scheduler->schedule(coro);
-			}
-		}
+			slot.state = state_;
+			slot.start = index * chunk_size;
+			slot.filled = 0;
+			slot.wanted = static_cast<std::size_t>(std::min<std::uint64_t>(chunk_size, state_->size - slot.start));
+			slot.error = 0;
+			slot.status.store(Slot::in_flight, std::memory_order::relaxed);
+			slot.callback = onChunkRead;
+			slot.op = io::Request::Op::read;
+			slot.fd = state_->fd;
+			slot.buffer = slot.data;
+			slot.length = slot.wanted;
+			slot.offset = slot.start;
 
-		MultipleAwaiter(std::initializer_list<Task<void, Allocator>> tasks) : coros()
-		{
-			for (auto& coro : tasks)
-				coros.emplace_back(PromiseBase::cast(coro.handle));
+			state_->refs.fetch_add(1, std::memory_order::relaxed);
+			state_->scheduler->retain_task();
+			state_->scheduler->submit(slot);
 		}
 
-		MultipleAwaiter(std::vector<Task<void, Allocator>>&& tasks) : coros()
+		static void onChunkRead(io::Request& request, std::int64_t result)
 		{
-			for (auto& coro : tasks)
-				coros.emplace_back(PromiseBase::cast(coro.handle));
-		}
+			auto& slot = static_cast<Slot&>(request);
+			State* state = slot.state;
 
-		~MultipleAwaiter()
-		{
-			for (auto& coro : coros)
-				coro.destroy();
-		}
+			if (result < 0)
+			{
+				slot.error = static_cast<int>(-result);
+			}
+			else
+			{
+				slot.filled += static_cast<std::size_t>(result);
 
-		std::vector<std::coroutine_handle<PromiseBase>> coros;
-	};
+				// short read, ask for the rest unless the reader is gone
+				if (result > 0 && slot.filled < slot.wanted && !state->abandoned.load(std::memory_order::acquire))
+				{
+					slot.buffer = slot.data + slot.filled;
+					slot.length = slot.wanted - slot.filled;
+					slot.offset = slot.start + slot.filled;
+					state->scheduler->submit(slot);
+					return;
+				}
+			}
 
-	template<typename T, typename Allocator = DefaultAllocator>
-	[[nodiscard]] auto all(std::initializer_list<Task<T, Allocator>> elements)
-	{
-		return MultipleAwaiter<T, Allocator>(std::move(elements));
-	};
+			if (slot.status.exchange(Slot::done, std::memory_order::acq_rel) == Slot::waiting)
+				state->scheduler->schedule_awaiting(slot.waiter);
 
-	template<typename Allocator = DefaultAllocator>
-	[[nodiscard]] auto all(std::initializer_list<Task<void, Allocator>> elements)
-	{
-		return MultipleAwaiter<void, Allocator>(std::move(elements));
-	};
+			// the state goes first, once run() may return nothing is left behind
+			Scheduler* scheduler = state->scheduler;
+			state->release();
+			scheduler->release_task();
+		}
 
-	template<typename T, typename Allocator = DefaultAllocator>
-	[[nodiscard]] auto all(std::vector<Task<T, Allocator>>&& elements)
-	{
-		return MultipleAwaiter<T, Allocator>(std::move(elements));
+		State* state_;
+		std::uint64_t chunk_count_ = 0;
+		std::uint64_t current_ = 0;
+		bool started_ = false;
+		bool cancelled_ = false;
 	};
 
-	template<typename Allocator = DefaultAllocator>
-	[[nodiscard]] auto all(std::vector<Task<void, Allocator>>&& elements)
+	/// Access pattern passed on to madvise() for a mapped file.
+	enum class MapAdvice
 	{
-		return MultipleAwaiter<void, Allocator>(std::move(elements));
+		normal,
+		sequential,
+		random,
+		willneed
 	};
 
-#ifdef _WIN32
-	void WINAPI onFileRead(
-		_In_    DWORD dwErrorCode,
-		_In_    DWORD dwNumberOfBytesTransfered,
-		_Inout_ LPOVERLAPPED lpOverlapped
-	);
-
-	struct ReadFileAwaiter : public OVERLAPPED
+	/// Read only view of a memory mapped file. Copies share the mapping, which is
+	/// unmapped once the last copy is gone.
+	class MappedFile
 	{
-		ReadFileAwaiter(const std::string& path) : OVERLAPPED(),
-			data_()
-		{
-			fileHandle_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, NULL);
+	public:
+		MappedFile() noexcept = default;
 
-			if (fileHandle_ == INVALID_HANDLE_VALUE)
-				throw std::runtime_error("Could not create file handle!");
+		MappedFile(const MappedFile& other) noexcept : mapping_(other.mapping_)
+		{
+			if (mapping_ != nullptr)
+				mapping_->refs.fetch_add(1, std::memory_order::relaxed);
 		}
 
-		bool await_ready() const noexcept
+		MappedFile(MappedFile&& other) noexcept : mapping_(std::exchange(other.mapping_, nullptr)) {}
+
+		MappedFile& operator=(MappedFile other) noexcept
 		{
-			return false;
+			std::swap(mapping_, other.mapping_);
+			return *this;
 		}
 
-		std::string await_resume() const
+		~MappedFile()
 		{
-			return std::move(data_);
+			if (mapping_ != nullptr && mapping_->refs.fetch_sub(1, std::memory_order::acq_rel) == 1)
+				delete mapping_;
 		}
 
-		void await_suspend(std::coroutine_handle<> handle)
+		[[nodiscard]] const char* data() const noexcept { return mapping_ == nullptr ? nullptr : static_cast<const char*>(mapping_->address); }
+		[[nodiscard]] std::size_t size() const noexcept { return mapping_ == nullptr ? 0 : mapping_->size; }
+		[[nodiscard]] bool empty() const noexcept { return size() == 0; }
+		[[nodiscard]] std::string_view view() const noexcept { return std::string_view(data(), size()); }
+
+	private:
+		friend struct MapFileAwaiter;
+
+		struct Mapping
 		{
-			handle_ = tasky::PromiseBase::cast(handle);
+			~Mapping() { ::munmap(address, size); }
 
-			[[maybe_unused]] DWORD fileSizeHigh = 0;
-			DWORD fileSizeLow = GetFileSize(fileHandle_, &fileSizeHigh);
+			void* address;
+			std::size_t size;
+			std::atomic<std::size_t> refs = 1;
+		};
 
-			data_.resize(fileSizeLow);
+		Mapping* mapping_ = nullptr;
+	};
 
-			if (!BindIoCompletionCallback(fileHandle_, onFileRead, 0))
-				throw std::runtime_error("Could not bind IO completion callback!");
+	/// Opens and maps the file on the reactor's pool, page faults from MAP_POPULATE or
+	/// madvise() read ahead then stall a pool thread rather than a worker.
+	struct MapFileAwaiter : public io::Request
+	{
+		MapFileAwaiter(std::string path, MapAdvice advice, bool populate) : io::Request(),
+			path_(std::move(path)),
+			advice_(advice),
+			populate_(populate)
+		{}
 
-			if (!ReadFile(fileHandle_, data_.data(), fileSizeLow, &read_, this))
-			{
-				const int err = GetLastError();
-				if (err != 997)
-					throw std::runtime_error("Could not read file!");
+		MapFileAwaiter(const MapFileAwaiter&) = delete;
+		MapFileAwaiter& operator=(const MapFileAwaiter&) = delete;
 
-			}
+		bool await_ready() const noexcept
+		{
+			return false;
 		}
 
-	private:
-		DWORD read_ = 0;
-		std::string data_;
-		void* fileHandle_ = nullptr;
-		std::coroutine_handle<tasky::PromiseBase> handle_ = nullptr;
+		MappedFile await_resume()
+		{
+			canceller_.disarm();
 
-		friend void WINAPI onFileRead(
-			_In_    DWORD dwErrorCode,
-			_In_    DWORD dwNumberOfBytesTransfered,
-			_Inout_ LPOVERLAPPED lpOverlapped
-		);
-	};
+			// the call never ran, one that did hands out its mapping even when cancelled
+			if (error_ == ECANCELED)
+				throw OperationCancelled();
 
-	void WINAPI onFileRead(
-		_In_    DWORD dwErrorCode,
-		_In_    DWORD dwNumberOfBytesTransfered,
-		_Inout_ LPOVERLAPPED lpOverlapped
-	)
-	{
-		auto* s = static_cast<ReadFileAwaiter*>(lpOverlapped);
+			if (error_ != 0)
+				throw std::runtime_error("Could not map file!");
 
-		if (!CloseHandle(s->fileHandle_))
-			throw std::runtime_error("Could not close file handle!");
+			MappedFile file;
 
-		s->handle_.promise().scheduler->schedule_awaiting(s->handle_);
-	}
+			if (address_ != nullptr)
+				file.mapping_ = new MappedFile::Mapping{ address_, size_ };
 
-	void WINAPI onFileWrite(
-		_In_    DWORD dwErrorCode,
-		_In_    DWORD dwNumberOfBytesTransfered,
-		_Inout_ LPOVERLAPPED lpOverlapped
-	);
+			return file;
+		}
 
-	struct WriteFileAwaiter : public OVERLAPPED
-	{
-		WriteFileAwaiter(const std::string& path, const std::string& data) : OVERLAPPED(),
-			data_(data)
+		void await_suspend(std::coroutine_handle<> handle)
 		{
-			fileHandle_ = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, NULL);
+			handle_ = tasky::PromiseBase::cast(handle);
 
-			if (fileHandle_ == INVALID_HANDLE_VALUE)
-				throw std::runtime_error("Could not create file handle!");
+			callback = onFileMapped;
+			work = mapOnPool;
+			op = Op::call;
+			canceller_.arm(handle_, *this);
+			Scheduler::current()->submit(*this);
 		}
 
-		bool await_ready() const noexcept
+	private:
+		static std::int64_t mapOnPool(io::Request& request)
 		{
-			return false;
-		}
+			auto& s = static_cast<MapFileAwaiter&>(request);
+			const int file = ::open(s.path_.c_str(), O_RDONLY | O_CLOEXEC);
 
-		void await_resume() const {}
+			if (file < 0)
+				return -errno;
 
-		void await_suspend(std::coroutine_handle<> handle)
-		{
-			handle_ = tasky::PromiseBase::cast(handle);
+			struct stat info = {};
 
-			if (!BindIoCompletionCallback(fileHandle_, onFileWrite, 0))
-				throw std::runtime_error("Could not bind IO completion callback!");
+			if (::fstat(file, &info) < 0)
+			{
+				const int error = errno;
+				::close(file);
+				return -error;
+			}
 
-			DWORD s = static_cast<DWORD>(data_.size());
+			s.size_ = static_cast<std::size_t>(info.st_size);
 
-			if (!WriteFile(fileHandle_, data_.data(), s, &written_, this))
+			// mmap refuses empty mappings, an empty file gives an empty view
+			if (s.size_ == 0)
 			{
-				const int err = GetLastError();
-				if (err != 997)
-					throw std::runtime_error("Could not write file!");
+				::close(file);
+				return 0;
 			}
-		}
 
-	private:
-		DWORD written_ = 0;
-		const std::string& data_;
-		void* fileHandle_ = nullptr;
-		std::coroutine_handle<tasky::PromiseBase> handle_ = nullptr;
+			void* address = ::mmap(nullptr, s.size_, PROT_READ, MAP_PRIVATE | (s.populate_ ? MAP_POPULATE : 0), file, 0);
+			const int error = errno;
+			::close(file);
 
-		friend void WINAPI onFileWrite(
-			_In_    DWORD dwErrorCode,
-			_In_    DWORD dwNumberOfBytesTransfered,
-			_Inout_ LPOVERLAPPED lpOverlapped
-		);
-	};
+			if (address == MAP_FAILED)
+				return -error;
 
-	void WINAPI onFileWrite(
-		_In_    DWORD dwErrorCode,
-		_In_    DWORD dwNumberOfBytesTransfered,
-		_Inout_ LPOVERLAPPED lpOverlapped
-	)
-	{
-		auto* s = static_cast<WriteFileAwaiter*>(lpOverlapped);
+			constexpr int advice[] = { MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED };
 
-		if (!CloseHandle(s->fileHandle_))
-			throw std::runtime_error("Could not close file handle!");
+			if (s.advice_ != MapAdvice::normal)
+				::madvise(address, s.size_, advice[static_cast<std::size_t>(s.advice_)]);
 
-		s->handle_.promise().scheduler->schedule_awaiting(s->handle_);
-	}
+			s.address_ = address;
+			return 0;
+		}
+
+		static void onFileMapped(io::Request& request, std::int64_t result)
+		{
+			auto& s = static_cast<MapFileAwaiter&>(request);
+
+			if (result < 0)
+				s.error_ = static_cast<int>(-result);
 
+			Scheduler::current()->schedule_awaiting(s.handle_);
+		}
+
+		std::string path_;
+		MapAdvice advice_;
+		bool populate_;
+		void* address_ = nullptr;
+		std::size_t size_ = 0;
+		int error_ = 0;
+		std::coroutine_handle<tasky::PromiseBase> handle_ = nullptr;
+		RequestCanceller canceller_;
+	};
 #endif
 
-	Task<std::string> readFile(const std::string& path)
+	// arguments are taken by value, the task only starts once it is awaited
+	inline Task<std::string> readFile(std::string path)
 	{
 		co_return co_await ReadFileAwaiter(path);
 	}
 
-	Task<void> writeFile(const std::string& path, const std::string& data)
+	inline Task<void> writeFile(std::string path, std::string data)
 	{
 		co_await WriteFileAwaiter(path, data);
 	}
+
+#ifdef __linux__
+	/// Maps the whole file instead of copying it, the view can be handed around freely.
+	inline Task<MappedFile> mapFile(std::string path, MapAdvice advice = MapAdvice::normal, bool populate = false)
+	{
+		co_return co_await MapFileAwaiter(std::move(path), advice, populate);
+	}
+#endif
 }
@@ -0,0 +1,224 @@
+#pragma once
+
+#include "pch.hpp"
+
+namespace timer
+{
+	/// Intrusive timer, the wheel links it in place so arming and cancelling never
+	/// allocate. `deadline` is in ticks of whatever clock drives the wheel.
+	struct Timer
+	{
+		using Callback = void (*)(Timer& timer);
+
+		static constexpr std::uint16_t unlinked = std::numeric_limits<std::uint16_t>::max();
+
+		Callback callback = nullptr;
+		std::uint64_t deadline = 0;
+
+		// owned by the wheel
+		Timer* prev = nullptr;
+		Timer* next = nullptr;
+		std::uint16_t slot = unlinked;
+
+		// owned by whoever keeps several wheels, which one the timer is in
+		std::uint32_t wheel = 0;
+	};
+
+	/// Hierarchical timing wheel (see "Hashed and Hierarchical Timing Wheels", Varghese
+	/// and Lauck 1987). Six levels of 64 slots, a slot on level n spans 64^n ticks, so
+	/// with millisecond ticks one turn of the wheel covers about two years; timers past
+	/// the current turn wait on an overflow list until the next one starts.
+	/// Insert and cancel are O(1), timers on outer levels move inward as time advances.
+	/// Not thread safe.
+	class Wheel
+	{
+	public:
+		static constexpr std::uint64_t never = std::numeric_limits<std::uint64_t>::max();
+
+		explicit Wheel(std::uint64_t now = 0) noexcept : elapsed_(now) {}
+
+		// non-copyable and non-movable
+		Wheel(const Wheel&) = delete;
+		Wheel& operator=(const Wheel&) = delete;
+
+		[[nodiscard]] std::size_t size() const noexcept { return size_; }
+		[[nodiscard]] bool empty() const noexcept { return size_ == 0; }
+
+		/// A deadline that already passed expires with the next advance().
+		void insert(Timer& timer) noexcept
+		{
+			size_++;
+			place(timer);
+		}
+
+		/// False when the timer is not in the wheel, i.e. it already expired.
+		bool cancel(Timer& timer) noexcept
+		{
+			if (timer.slot == Timer::unlinked)
+				return false;
+
+			unlink(timer);
+			size_--;
+			return true;
+		}
+
+		/// Tick from which advance() has something to do, `never` when the wheel is empty.
+		/// For timers on outer levels this is the start of their slot, which may come
+		/// before their deadline.
+		[[nodiscard]] std::uint64_t next_deadline() const noexcept
+		{
+			if (heads_[expired_slot] != nullptr)
+				return elapsed_;
+
+			std::size_t level = 0;
+			std::size_t slot = 0;
+			std::uint64_t start = 0;
+
+			if (next_slot(level, slot, start))
+				return start;
+
+			return heads_[overflow_slot] != nullptr ? (elapsed_ | (span - 1)) + 1 : never;
+		}
+
+		/// Moves the wheel to `now` and unlinks every timer whose deadline has passed, they
+		/// are returned as a list linked through `next` so the caller can run them after
+		/// letting go of whatever protects the wheel.
+		[[nodiscard]] Timer* advance(std::uint64_t now) noexcept
+		{
+			Timer* fired = nullptr;
+			Timer* timer = std::exchange(heads_[expired_slot], nullptr);
+
+			while (timer != nullptr)
+				timer = expire(*timer, fired);
+
+			std::size_t level = 0;
+			std::size_t slot = 0;
+			std::uint64_t start = 0;
+
+			for (;;)
+			{
+				if (next_slot(level, slot, start) && start <= now)
+				{
+					elapsed_ = start;
+					timer = std::exchange(heads_[level * slots + slot], nullptr);
+					occupied_[level] &= ~(std::uint64_t(1) << slot);
+				}
+				else if (heads_[overflow_slot] != nullptr && now > (elapsed_ | (span - 1)))
+				{
+					// the wheel is empty up to the end of this turn, start the next one
+					elapsed_ = (elapsed_ | (span - 1)) + 1;
+					timer = std::exchange(heads_[overflow_slot], nullptr);
+				}
+				else
+				{
+					break;
+				}
+
+				while (timer != nullptr)
+				{
+					if (timer->deadline <= elapsed_)
+					{
+						timer = expire(*timer, fired);
+					}
+					else
+					{
+						Timer* next = timer->next;
+						place(*timer);
+						timer = next;
+					}
+				}
+			}
+
+			elapsed_ = std::max(elapsed_, now);
+			return fired;
+		}
+
+	private:
+		static constexpr std::size_t levels = 6;
+		static constexpr std::size_t slots = 64;
+		static constexpr std::size_t slot_bits = 6;
+		static constexpr std::uint64_t span = std::uint64_t(1) << (levels * slot_bits);
+		static constexpr std::uint16_t expired_slot = levels * slots;
+		static constexpr std::uint16_t overflow_slot = levels * slots + 1;
+
+		/// Every timer sits in the slot of its deadline on the lowest level where the
+		/// deadline and `elapsed_` share the slot above, so on every level the occupied
+		/// slots lie after the one `elapsed_` is in.
+		void place(Timer& timer) noexcept
+		{
+			std::size_t index = expired_slot;
+
+			if (timer.deadline > (elapsed_ | (span - 1)))
+			{
+				index = overflow_slot;
+			}
+			else if (timer.deadline > elapsed_)
+			{
+				const std::size_t level = static_cast<std::size_t>(63 - std::countl_zero((elapsed_ ^ timer.deadline) | (slots - 1))) / slot_bits;
+				const std::size_t slot = static_cast<std::size_t>(timer.deadline >> (level * slot_bits)) & (slots - 1);
+
+				occupied_[level] |= std::uint64_t(1) << slot;
+				index = level * slots + slot;
+			}
+
+			timer.slot = static_cast<std::uint16_t>(index);
+			timer.prev = nullptr;
+			timer.next = heads_[index];
+
+			if (timer.next != nullptr)
+				timer.next->prev = &timer;
+
+			heads_[index] = &timer;
+		}
+
+		void unlink(Timer& timer) noexcept
+		{
+			if (timer.prev != nullptr)
+				timer.prev->next = timer.next;
+			else
+				heads_[timer.slot] = timer.next;
+
+			if (timer.next != nullptr)
+				timer.next->prev = timer.prev;
+
+			if (heads_[timer.slot] == nullptr && timer.slot < expired_slot)
+				occupied_[timer.slot / slots] &= ~(std::uint64_t(1) << (timer.slot % slots));
+
+			timer.slot = Timer::unlinked;
+		}
+
+		/// Moves the timer onto the fired list, returns the one that followed it.
+		Timer* expire(Timer& timer, Timer*& fired) noexcept
+		{
+			Timer* next = timer.next;
+			timer.slot = Timer::unlinked;
+			timer.prev = nullptr;
+			timer.next = fired;
+			fired = &timer;
+			size_--;
+			return next;
+		}
+
+		/// Earliest occupied slot, lower levels always come first.
+		bool next_slot(std::size_t& level, std::size_t& slot, std::uint64_t& start) const noexcept
+		{
+			for (level = 0; level < levels; level++)
+			{
+				if (occupied_[level] == 0)
+					continue;
+
+				const std::size_t shift = level * slot_bits;
+				slot = static_cast<std::size_t>(std::countr_zero(occupied_[level]));
+				start = (elapsed_ & ~((std::uint64_t(1) << (shift + slot_bits)) - 1)) + (std::uint64_t(slot) << shift);
+				return true;
+			}
+
+			return false;
+		}
+
+		std::uint64_t elapsed_;
+		std::size_t size_ = 0;
+		std::uint64_t occupied_[levels] = {};
+		Timer* heads_[levels * slots + 2] = {};
+	};
+}
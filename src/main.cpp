@@ -5,11 +5,12 @@ using namespace tasky;
 
 Task<void> read()
 {
-	auto s = co_await all({
-		readFile("C:\\Users\\lilov\\Desktop\\test.txt"),
-		readFile("C:\\Users\\lilov\\Desktop\\test2.txt"),
-		readFile("C:\\Users\\lilov\\Desktop\\test3.txt")
-	});
+	// GCC 12 can't put a braced list of tasks inside a coroutine ("array used as initializer")
+	std::vector<Task<std::string>> files;
+	for (const char* path : { "C:\\Users\\lilov\\Desktop\\test.txt", "C:\\Users\\lilov\\Desktop\\test2.txt", "C:\\Users\\lilov\\Desktop\\test3.txt" })
+		files.emplace_back(readFile(path));
+
+	auto s = co_await all(std::move(files));
 
 	for (const auto& str : s)
 		std::cout << str.c_str() << std::endl;
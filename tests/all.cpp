@@ -0,0 +1,107 @@
+#include "check.hpp"
+
+#include <ranges>
+
+using namespace tasky;
+
+namespace
+{
+	Task<int> number(int value)
+	{
+		co_return value;
+	}
+
+	Task<std::string> text(std::string value)
+	{
+		co_return value;
+	}
+
+	Task<void> mark(std::atomic<bool>& ran)
+	{
+		ran = true;
+		co_return;
+	}
+
+	/// Throws once `gate` is open, so the order in which the tasks fail is up to the test.
+	Task<int> failing(int id, std::atomic<bool>& gate, std::atomic<bool>& thrown)
+	{
+		while (!gate.load())
+			std::this_thread::yield();
+
+		thrown = true;
+		throw std::runtime_error(std::to_string(id));
+		co_return 0;
+	}
+
+	/// Opens `gate` once `after` is set.
+	Task<int> relay(std::atomic<bool>& after, std::atomic<bool>& gate)
+	{
+		while (!after.load())
+			std::this_thread::yield();
+
+		gate = true;
+		co_return 3;
+	}
+
+	Task<bool> mixed()
+	{
+		std::atomic<bool> ran = false;
+		auto [a, b, c] = co_await all(number(1), text("two"), mark(ran));
+
+		static_assert(std::is_same_v<decltype(c), std::monostate>);
+		co_return a == 1 && b == "two" && ran;
+	}
+
+	Task<std::string> first_failure()
+	{
+		// the second task throws first, the first one only once the third saw that
+		std::atomic<bool> first_gate = false;
+		std::atomic<bool> second_gate = true;
+		std::atomic<bool> first_thrown = false;
+		std::atomic<bool> second_thrown = false;
+
+		try
+		{
+			co_await all(failing(1, first_gate, first_thrown), failing(2, second_gate, second_thrown), relay(second_thrown, first_gate));
+		}
+		catch (const std::runtime_error& e)
+		{
+			co_return e.what();
+		}
+
+		co_return "none";
+	}
+
+	Task<std::vector<int>> numbers(int count)
+	{
+		std::vector<Task<int>> tasks;
+		for (int i = 0; i < count; i++)
+			tasks.push_back(number(i));
+
+		co_return co_await all(std::move(tasks));
+	}
+}
+
+TEST(all_mixed_types)
+{
+	Scheduler scheduler(check::workers);
+
+	CHECK(check::run(scheduler, mixed()));
+}
+
+TEST(all_vector_in_order)
+{
+	Scheduler scheduler(check::workers);
+	const std::vector<int> values = check::run(scheduler, numbers(100));
+
+	CHECK(values.size() == 100);
+	CHECK(std::ranges::equal(values, std::views::iota(0, 100)));
+}
+
+TEST(all_rethrows_in_task_order)
+{
+	Scheduler scheduler(check::workers);
+
+	// both failed by the time all() resumes, the first task's exception is the one seen
+	CHECK(check::run(scheduler, first_failure()) == "1");
+}
@@ -0,0 +1,235 @@
+#include "check.hpp"
+
+#include "lockfree/deque.hpp"
+#include "lockfree/segmented_queue.hpp"
+
+#include <numeric>
+
+using namespace tasky;
+using namespace std::chrono_literals;
+
+namespace
+{
+	constexpr std::size_t producers = 3;
+	constexpr std::size_t per_producer = 20000;
+	constexpr std::size_t total = producers * per_producer;
+
+	/// Odd sizes, so the batches keep ending at different places around the ring.
+	constexpr std::size_t push_batch = 7;
+	constexpr std::size_t pop_batch = 5;
+
+	[[nodiscard]] bool exactly_once(const std::vector<std::atomic<std::size_t>>& seen)
+	{
+		return std::ranges::all_of(seen, [](const auto& count) { return count == 1; });
+	}
+
+	/// Producers hand their elements to `push(first, count)` a batch at a time, the
+	/// consumers take them with `pop(out, max)` until every element is out. Gives up
+	/// after a while so a lost element fails the test instead of hanging it.
+	template<typename Push, typename Pop>
+	void batches(std::vector<std::atomic<std::size_t>>& seen, Push push, Pop pop)
+	{
+		std::atomic<std::size_t> taken = 0;
+		const auto deadline = std::chrono::steady_clock::now() + 30s;
+		std::vector<std::thread> threads;
+
+		for (std::size_t p = 0; p < producers; p++)
+		{
+			threads.emplace_back([&push, p]()
+			{
+				std::vector<std::size_t> values(per_producer);
+				std::iota(values.begin(), values.end(), p * per_producer);
+
+				for (std::size_t i = 0; i < values.size(); i += push_batch)
+					push(values.data() + i, std::min(push_batch, values.size() - i));
+			});
+		}
+
+		for (std::size_t c = 0; c < 2; c++)
+		{
+			threads.emplace_back([&]()
+			{
+				std::size_t out[pop_batch];
+
+				while (taken.load() < total && std::chrono::steady_clock::now() < deadline)
+				{
+					const std::size_t n = pop(out, pop_batch);
+
+					for (std::size_t i = 0; i < n; i++)
+						seen[out[i]]++;
+
+					if (n == 0)
+						std::this_thread::yield();
+
+					taken += n;
+				}
+			});
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+	}
+
+	Task<void> mark(std::vector<std::atomic<std::size_t>>& runs, std::size_t index)
+	{
+		runs[index]++;
+		co_return;
+	}
+}
+
+TEST(queue_bulk_wraps_around)
+{
+	lockfree::Queue<int> queue(8);
+	const int values[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+
+	CHECK(queue.try_push_n(values, 5) == 5);
+
+	int out[10] = {};
+	CHECK(queue.try_pop_n(out, 3) == 3);
+	CHECK(out[0] == 0 && out[2] == 2);
+
+	// two elements left, so only six of the ten fit, across the end of the ring
+	CHECK(queue.try_push_n(values + 5, 5) == 5);
+	CHECK(queue.try_push_n(values, 10) == 1);
+	CHECK(queue.try_push_n(values, 10) == 0);
+
+	CHECK(queue.try_pop_n(out, 10) == 8);
+	CHECK((std::ranges::equal(std::span(out, 8), std::array{ 3, 4, 5, 6, 7, 8, 9, 0 })));
+	CHECK(queue.try_pop_n(out, 10) == 0);
+}
+
+TEST(queue_bulk_closed)
+{
+	lockfree::Queue<int> queue(8);
+	const int values[] = { 1, 2, 3 };
+
+	CHECK(queue.try_push_n(values, 3) == 3);
+	queue.close();
+	CHECK(queue.try_push_n(values, 3) == 0);
+
+	int out[8] = {};
+	CHECK(queue.try_pop_n(out, 8) == 3);
+	CHECK(out[0] == 1 && out[2] == 3);
+}
+
+TEST(queue_bulk_exactly_once)
+{
+	lockfree::Queue<std::size_t> queue(64);
+	std::vector<std::atomic<std::size_t>> seen(total);
+
+	// a partial batch leaves the rest for the next attempt
+	batches(seen,
+		[&](const std::size_t* first, std::size_t count) {
+			while (count > 0)
+			{
+				const std::size_t pushed = queue.try_push_n(first, count);
+				first += pushed;
+				count -= pushed;
+
+				if (pushed == 0)
+					std::this_thread::yield();
+			}
+		},
+		[&](std::size_t* out, std::size_t max) { return queue.try_pop_n(out, max); });
+
+	CHECK(exactly_once(seen));
+	CHECK(queue.empty());
+}
+
+TEST(segmented_queue_bulk_exactly_once)
+{
+	lockfree::SegmentedQueue<std::size_t> queue(4);
+	std::vector<std::atomic<std::size_t>> seen(total);
+
+	batches(seen,
+		[&](const std::size_t* first, std::size_t count) { queue.push_n(first, count); },
+		[&](std::size_t* out, std::size_t max) { return queue.try_pop_n(out, max); });
+
+	CHECK(exactly_once(seen));
+	CHECK(queue.capacity() > 4);
+	CHECK(queue.empty());
+}
+
+TEST(deque_push_n_with_stealers)
+{
+	constexpr std::size_t count = 50000;
+
+	lockfree::WorkStealingDeque<std::size_t> deque(2);
+	std::vector<std::atomic<std::size_t>> seen(count);
+	std::atomic<std::size_t> taken = 0;
+	std::atomic<bool> pushed = false;
+
+	std::vector<std::thread> stealers;
+	for (std::size_t i = 0; i < 2; i++)
+	{
+		stealers.emplace_back([&]()
+		{
+			std::size_t value = 0;
+
+			while (!pushed || taken < count)
+			{
+				if (deque.try_steal(value))
+				{
+					seen[value]++;
+					taken++;
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+
+	// the owner pushes in batches that make the buffer grow and pops now and then
+	std::vector<std::size_t> values(count);
+	std::iota(values.begin(), values.end(), std::size_t(0));
+
+	for (std::size_t i = 0; i < count; i += push_batch)
+	{
+		deque.push_n(values.data() + i, std::min(push_batch, count - i));
+
+		std::size_t value = 0;
+		if (i % 3 == 0 && deque.try_pop(value))
+		{
+			seen[value]++;
+			taken++;
+		}
+	}
+
+	pushed = true;
+
+	std::size_t value = 0;
+	while (deque.try_pop(value))
+	{
+		seen[value]++;
+		taken++;
+	}
+
+	for (auto& stealer : stealers)
+		stealer.join();
+
+	CHECK(exactly_once(seen));
+	CHECK(deque.empty());
+}
+
+TEST(schedule_batch_into_shared_queue)
+{
+	constexpr std::size_t count = 5000;
+
+	Scheduler scheduler(check::workers, 16);
+	const std::size_t capacity = scheduler.queue_capacity();
+	std::vector<std::atomic<std::size_t>> runs(count);
+
+	std::vector<Task<void>> tasks;
+	for (std::size_t i = 0; i < count; i++)
+		tasks.push_back(mark(runs, i));
+
+	// one push_n from outside the pool, more than the queue holds
+	scheduler.schedule(tasks);
+	CHECK(scheduler.queue_size() == count);
+	CHECK(scheduler.queue_capacity() > capacity);
+
+	scheduler.run();
+	CHECK(std::ranges::all_of(runs, [](const auto& count) { return count == 1; }));
+}
@@ -0,0 +1,216 @@
+#include "check.hpp"
+
+using namespace tasky;
+using namespace std::chrono_literals;
+using check::Clock;
+using check::DelayedCancel;
+
+namespace
+{
+	Task<void> sleep(std::chrono::milliseconds duration, std::atomic<bool>& woke)
+	{
+		co_await sleep_for(duration);
+		woke = true;
+	}
+
+	Task<bool> cancelled(Task<void> task)
+	{
+		try
+		{
+			co_await task;
+		}
+		catch (const OperationCancelled&)
+		{
+			co_return true;
+		}
+
+		co_return false;
+	}
+
+#if defined(__linux__)
+	/// One read from a pipe, the same shape as ReadFileAwaiter. With nothing written to
+	/// the pipe it stays in flight until it is cancelled.
+	class PipeRead : public io::Request
+	{
+	public:
+		explicit PipeRead(int pipe) : io::Request()
+		{
+			fd = pipe;
+			op = Op::read;
+			buffer = &byte_;
+			length = 1;
+			callback = onRead;
+		}
+
+		bool await_ready() const noexcept { return false; }
+
+		void await_suspend(std::coroutine_handle<> handle)
+		{
+			handle_ = PromiseBase::cast(handle);
+			canceller_.arm(handle_, *this);
+			Scheduler::current()->submit(*this);
+		}
+
+		char await_resume()
+		{
+			canceller_.disarm();
+
+			if (result_ == -ECANCELED)
+				throw OperationCancelled();
+
+			CHECK(result_ == 1);
+			return byte_;
+		}
+
+	private:
+		static void onRead(io::Request& request, std::int64_t result)
+		{
+			auto& r = static_cast<PipeRead&>(request);
+			r.result_ = result;
+			Scheduler::current()->schedule_awaiting(r.handle_);
+		}
+
+		char byte_ = 0;
+		std::int64_t result_ = 0;
+		std::coroutine_handle<PromiseBase> handle_ = nullptr;
+		RequestCanceller canceller_;
+	};
+
+	Task<void> read_pipe(int pipe)
+	{
+		co_await PipeRead(pipe);
+	}
+#endif
+
+	/// Counts how often it ran.
+	struct Counter : public CancellationCallback
+	{
+		Counter()
+		{
+			function = [](CancellationCallback& callback) { static_cast<Counter&>(callback).runs++; };
+		}
+
+		std::atomic<std::size_t> runs = 0;
+	};
+}
+
+TEST(cancel_sleeping_task)
+{
+	Scheduler scheduler(check::workers);
+	CancellationSource source;
+	std::atomic<bool> woke = false;
+
+	const auto start = Clock::now();
+	bool thrown = false;
+	{
+		DelayedCancel cancel(source, 20ms);
+		thrown = check::run(scheduler, cancelled(with_cancellation(sleep(10s, woke), source.token())));
+	}
+
+	// the timer was taken out of the wheel rather than left to run out
+	CHECK(thrown);
+	CHECK(!woke);
+	CHECK(Clock::now() - start < 5s);
+
+	// a task that starts out cancelled never gets to sleep
+	CHECK(check::run(scheduler, cancelled(with_cancellation(sleep(10s, woke), source.token()))));
+	CHECK(!woke);
+}
+
+#if defined(__linux__)
+TEST(cancel_read_in_flight)
+{
+	Scheduler scheduler(check::workers);
+
+	// the thread pool cannot stop a read it already started
+	if (!scheduler.reactor().uses_io_uring())
+		return;
+
+	int pipe[2] = {};
+	CHECK(::pipe2(pipe, O_CLOEXEC) == 0);
+
+	CancellationSource source;
+	const auto start = Clock::now();
+	bool thrown = false;
+	{
+		DelayedCancel cancel(source, 20ms);
+		thrown = check::run(scheduler, cancelled(with_cancellation(read_pipe(pipe[0]), source.token())));
+	}
+
+	CHECK(thrown);
+	CHECK(Clock::now() - start < 5s);
+
+	// the cancelled read took nothing, the byte is still there
+	const char byte = 'x';
+	CHECK(::write(pipe[1], &byte, 1) == 1);
+
+	char echoed = 0;
+	CHECK(::read(pipe[0], &echoed, 1) == 1);
+	CHECK(echoed == byte);
+
+	::close(pipe[0]);
+	::close(pipe[1]);
+}
+#endif
+
+TEST(child_unlink_races_parent_cancel)
+{
+	constexpr std::size_t rounds = 1000;
+
+	for (std::size_t i = 0; i < rounds; i++)
+	{
+		CancellationSource parent;
+		std::atomic<bool> go = false;
+
+		std::thread canceller([&]()
+		{
+			while (!go)
+				std::this_thread::yield();
+
+			parent.cancel();
+		});
+
+		Counter counter;
+		bool removed = false;
+
+		// the callback and the child go away while the parent may be cancelling them
+		if (i % 2 == 0)
+		{
+			CancellationSource child(parent.token());
+			CancellationToken token = child.token();
+			CHECK(token.add(counter));
+			go = true;
+			removed = token.remove(counter);
+		}
+		else
+		{
+			CancellationSource child(parent.token());
+			CancellationSource grandchild(child.token());
+			CHECK(grandchild.token().add(counter));
+			go = true;
+			removed = grandchild.token().remove(counter);
+		}
+
+		canceller.join();
+
+		// remove() either took the callback out or waited for it to finish
+		CHECK(parent.cancelled());
+		CHECK(counter.runs == (removed ? 0 : 1));
+	}
+
+	// a child that outlives the cancel is cancelled with its parent
+	CancellationSource parent;
+	CancellationSource child(parent.token());
+	Counter counter;
+	CHECK(child.token().add(counter));
+
+	std::thread canceller([&]() { parent.cancel(); });
+	canceller.join();
+
+	CHECK(child.cancelled());
+	CHECK(counter.runs == 1);
+
+	// and one made from a cancelled parent starts out cancelled
+	CancellationSource late(parent.token());
+	CHECK(late.cancelled());
+}
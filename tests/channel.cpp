@@ -0,0 +1,232 @@
+#include "check.hpp"
+
+using namespace tasky;
+using namespace std::chrono_literals;
+
+namespace
+{
+	Task<void> produce(Channel<std::size_t>& output, std::size_t count)
+	{
+		for (std::size_t i = 1; i <= count; i++)
+		{
+			const bool sent = co_await output.send(i);
+			CHECK(sent);
+		}
+
+		output.close();
+	}
+
+	Task<void> twice(Channel<std::size_t>& input, Channel<std::size_t>& output, std::atomic<std::size_t>& running)
+	{
+		while (auto value = co_await input.recv())
+		{
+			const bool sent = co_await output.send(*value * 2);
+			CHECK(sent);
+		}
+
+		if (--running == 0)
+			output.close();
+	}
+
+	Task<void> consume(Channel<std::size_t>& input, std::size_t& sum, std::size_t& count)
+	{
+		while (auto value = co_await input.recv())
+		{
+			sum += *value;
+			count++;
+		}
+	}
+
+	Task<void> send_one(Channel<int>& channel, int value, std::atomic<std::size_t>& failed)
+	{
+		const bool sent = co_await channel.send(value);
+
+		if (!sent)
+			failed++;
+	}
+
+	Task<void> receive_one(Channel<int>& channel, std::atomic<std::size_t>& empty)
+	{
+		const auto value = co_await channel.recv();
+
+		if (!value)
+			empty++;
+	}
+
+	Task<void> close_later(Channel<int>& channel)
+	{
+		co_await sleep_for(10ms);
+		channel.close();
+	}
+
+	Task<void> drain(Channel<int>& channel, std::vector<int>& values)
+	{
+		while (auto value = co_await channel.recv())
+			values.push_back(*value);
+
+		const bool sent = co_await channel.send(5);
+		CHECK(!sent);
+	}
+
+	Task<void> send_range(Channel<std::size_t>& channel, std::size_t first, std::size_t count, std::atomic<std::size_t>& running)
+	{
+		for (std::size_t i = first; i < first + count; i++)
+		{
+			const bool sent = co_await channel.send(i);
+			CHECK(sent);
+		}
+
+		if (--running == 0)
+			channel.close();
+	}
+
+	Task<void> receive_all(Channel<std::size_t>& channel, std::vector<std::atomic<std::size_t>>& received)
+	{
+		while (auto value = co_await channel.recv())
+			received[*value]++;
+	}
+
+	/// Move-only and without a default constructor, counts the live objects.
+	class Token
+	{
+	public:
+		explicit Token(int value) : value_(std::make_unique<int>(value))
+		{
+			live++;
+		}
+
+		Token(Token&& other) noexcept : value_(std::move(other.value_))
+		{
+			live++;
+		}
+
+		Token& operator=(Token&&) noexcept = default;
+
+		~Token()
+		{
+			live--;
+		}
+
+		[[nodiscard]] int value() const noexcept { return *value_; }
+
+		static inline std::atomic<int> live = 0;
+
+	private:
+		std::unique_ptr<int> value_;
+	};
+}
+
+TEST(channel_pipeline)
+{
+	constexpr std::size_t count = 20000;
+	constexpr std::size_t doublers = 3;
+
+	Scheduler scheduler(check::workers);
+	Channel<std::size_t> numbers(8);
+	Channel<std::size_t> doubled(4);
+	std::atomic<std::size_t> running = doublers;
+	std::size_t sum = 0;
+	std::size_t received = 0;
+
+	std::vector<Task<void>> stages;
+	stages.push_back(produce(numbers, count));
+
+	for (std::size_t i = 0; i < doublers; i++)
+		stages.push_back(twice(numbers, doubled, running));
+
+	stages.push_back(consume(doubled, sum, received));
+	check::run(scheduler, check::join(std::move(stages)));
+
+	CHECK(received == count);
+	CHECK(sum == count * (count + 1));
+	CHECK(numbers.size() == 0);
+	CHECK(doubled.size() == 0);
+}
+
+TEST(channel_close_fails_pending_sends)
+{
+	Scheduler scheduler(check::workers);
+	Channel<int> channel(2);
+	std::atomic<std::size_t> failed = 0;
+
+	CHECK(channel.try_send(1));
+	CHECK(channel.try_send(2));
+	CHECK(!channel.try_send(3));
+
+	// full, so every one of them suspends until close()
+	std::vector<Task<void>> tasks;
+	for (int i = 0; i < 10; i++)
+		tasks.push_back(send_one(channel, 10 + i, failed));
+
+	tasks.push_back(close_later(channel));
+	check::run(scheduler, check::join(std::move(tasks)));
+
+	CHECK(failed == 10);
+	CHECK(channel.closed());
+	CHECK(!channel.try_send(4));
+
+	// what was sent before close() is still there
+	std::vector<int> values;
+	check::run(scheduler, drain(channel, values));
+
+	CHECK((values == std::vector<int>{ 1, 2 }));
+	CHECK(!channel.try_recv());
+}
+
+TEST(channel_close_wakes_receivers)
+{
+	Scheduler scheduler(check::workers);
+	Channel<int> channel(4);
+	std::atomic<std::size_t> empty = 0;
+
+	std::vector<Task<void>> tasks;
+	for (int i = 0; i < 10; i++)
+		tasks.push_back(receive_one(channel, empty));
+
+	tasks.push_back(close_later(channel));
+	check::run(scheduler, check::join(std::move(tasks)));
+
+	CHECK(empty == 10);
+}
+
+TEST(channel_many_to_many)
+{
+	constexpr std::size_t senders = 8;
+	constexpr std::size_t per_sender = 2000;
+
+	// a tiny ring, so slots are handed back and forth while their last user is busy
+	Scheduler scheduler(check::workers);
+	Channel<std::size_t> channel(3);
+	std::vector<std::atomic<std::size_t>> received(senders * per_sender);
+	std::atomic<std::size_t> running = senders;
+
+	std::vector<Task<void>> tasks;
+
+	for (std::size_t i = 0; i < senders; i++)
+	{
+		tasks.push_back(send_range(channel, i * per_sender, per_sender, running));
+		tasks.push_back(receive_all(channel, received));
+	}
+
+	check::run(scheduler, check::join(std::move(tasks)));
+
+	CHECK(std::ranges::all_of(received, [](const auto& count) { return count == 1; }));
+	CHECK(channel.size() == 0);
+}
+
+TEST(channel_move_only)
+{
+	{
+		Channel<Token> channel(4);
+
+		CHECK(channel.try_send(Token(1)));
+		CHECK(channel.try_send(Token(2)));
+		CHECK(channel.try_send(Token(3)));
+
+		auto first = channel.try_recv();
+		CHECK(first && first->value() == 1);
+	}
+
+	// the elements left in the channel went with it
+	CHECK(Token::live == 0);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "pch.hpp"
+#include "tasky.hpp"
+
+/// Just enough of a test harness for tasky_tests: TEST() registers a function, CHECK()
+/// throws when its condition is false. A CHECK inside a task propagates like any other
+/// exception, out of Scheduler::run() and into the runner.
+namespace check
+{
+	struct Case
+	{
+		const char* name;
+		void (*run)();
+	};
+
+	class Failure : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error;
+	};
+
+	[[nodiscard]] inline std::vector<Case>& cases()
+	{
+		static std::vector<Case> list;
+		return list;
+	}
+
+	struct Registration
+	{
+		Registration(const char* name, void (*run)())
+		{
+			cases().push_back({ name, run });
+		}
+	};
+
+	[[noreturn]] inline void fail(const char* expression, const char* file, int line)
+	{
+		throw Failure(std::string(file) + ":" + std::to_string(line) + ": CHECK(" + expression + ") failed");
+	}
+
+	/// Threads besides the one calling run(), enough for tasks to overlap on any machine.
+	constexpr std::size_t workers = 3;
+
+	template<typename T, typename Allocator>
+	tasky::Task<void> capture(tasky::Task<T, Allocator> task, std::optional<T>& result)
+	{
+		result.emplace(co_await task);
+	}
+
+	/// Runs the task as the scheduler's only root task and returns its value, rethrows
+	/// what it threw.
+	template<typename T, typename Allocator>
+	T run(tasky::Scheduler& scheduler, tasky::Task<T, Allocator> task)
+	{
+		if constexpr (std::is_void_v<T>)
+		{
+			scheduler.schedule(task);
+			scheduler.run();
+		}
+		else
+		{
+			std::optional<T> result;
+			auto root = capture(std::move(task), result);
+			scheduler.schedule(root);
+			scheduler.run();
+			return std::move(*result);
+		}
+	}
+
+	/// all() as a task, for run().
+	inline tasky::Task<void> join(std::vector<tasky::Task<void>> tasks)
+	{
+		co_await tasky::all(std::move(tasks));
+	}
+
+	/// Notes FramePool::in_use() when created, for checking that no frame was leaked.
+	class FrameCount
+	{
+	public:
+		[[nodiscard]] bool balanced() const noexcept
+		{
+			return tasky::FramePool::in_use() == before_;
+		}
+
+	private:
+		const std::size_t before_ = tasky::FramePool::in_use();
+	};
+
+	using Clock = std::chrono::steady_clock;
+
+	/// Returns `value` once `delay` passed, from a FramePool frame.
+	inline tasky::Task<int, tasky::FramePool> after(std::chrono::milliseconds delay, int value)
+	{
+		co_await tasky::sleep_for(delay);
+		co_return value;
+	}
+
+	/// Cancels the source from another thread after a while.
+	class DelayedCancel
+	{
+	public:
+		DelayedCancel(tasky::CancellationSource& source, std::chrono::milliseconds delay) :
+			thread_([&source, delay]()
+			{
+				std::this_thread::sleep_for(delay);
+				source.cancel();
+			})
+		{}
+
+		~DelayedCancel()
+		{
+			thread_.join();
+		}
+
+	private:
+		std::thread thread_;
+	};
+}
+
+#define TEST(name) \
+	static void name(); \
+	static const check::Registration name##_registration(#name, name); \
+	static void name()
+
+#define CHECK(expression) ((expression) ? void() : check::fail(#expression, __FILE__, __LINE__))
@@ -0,0 +1,193 @@
+#include "check.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+using namespace tasky;
+using namespace std::chrono_literals;
+using check::Clock;
+
+#if defined(__linux__)
+namespace
+{
+	/// A file of `size` bytes counting up from 0, removed again with the object.
+	class TempFile
+	{
+	public:
+		explicit TempFile(std::size_t size)
+		{
+			auto path = std::filesystem::temp_directory_path() / "tasky_tests_";
+			path += std::to_string(::getpid());
+			path += "_";
+			path += std::to_string(size);
+			path_ = path.string();
+
+			std::string data(size, '\0');
+
+			for (std::size_t i = 0; i < size; i++)
+				data[i] = static_cast<char>(i % 251);
+
+			std::ofstream(path_, std::ios::binary).write(data.data(), static_cast<std::streamsize>(data.size()));
+			contents_ = std::move(data);
+		}
+
+		~TempFile()
+		{
+			std::filesystem::remove(path_);
+		}
+
+		[[nodiscard]] const std::string& path() const noexcept { return path_; }
+		[[nodiscard]] const std::string& contents() const noexcept { return contents_; }
+
+	private:
+		std::string path_;
+		std::string contents_;
+	};
+
+	/// Descriptors open in this process, a reader left behind keeps its file open.
+	[[nodiscard]] std::size_t open_files()
+	{
+		return static_cast<std::size_t>(std::distance(std::filesystem::directory_iterator("/proc/self/fd"), {}));
+	}
+
+	Task<std::string> read_all(std::string path, std::shared_ptr<BufferPool> pool, std::size_t read_ahead)
+	{
+		FileReader reader(path, std::move(pool), read_ahead);
+		std::string data;
+
+		while (auto chunk = co_await reader.next())
+		{
+			CHECK(chunk->offset == data.size());
+			data += chunk->data;
+		}
+
+		co_return data;
+	}
+
+	/// Takes the first chunk and drops the reader with the others still in flight.
+	Task<std::size_t> read_first(std::string path, std::shared_ptr<BufferPool> pool)
+	{
+		FileReader reader(path, std::move(pool), 16);
+		auto chunk = co_await reader.next();
+		co_return chunk->data.size();
+	}
+
+	/// Cancels itself after the first chunk and counts how often next() throws then.
+	Task<int> cancel_after_first(std::string path, std::shared_ptr<BufferPool> pool, CancellationSource& source)
+	{
+		FileReader reader(path, std::move(pool), 8);
+		auto chunk = co_await reader.next();
+		CHECK(chunk.has_value());
+
+		source.cancel();
+		int thrown = 0;
+
+		for (int i = 0; i < 2; i++)
+		{
+			try
+			{
+				chunk = co_await reader.next();
+			}
+			catch (const OperationCancelled&)
+			{
+				thrown++;
+			}
+		}
+
+		co_return thrown;
+	}
+
+	/// Reads the file over and over until the task is cancelled.
+	Task<bool> read_until_cancelled(std::string path, std::shared_ptr<BufferPool> pool)
+	{
+		try
+		{
+			for (;;)
+			{
+				FileReader reader(path, pool, 8);
+
+				while (co_await reader.next())
+					;
+			}
+		}
+		catch (const OperationCancelled&)
+		{
+			co_return true;
+		}
+	}
+}
+
+TEST(file_reader_streams)
+{
+	const TempFile file(1024 * 1024 + 123);
+	Scheduler scheduler(check::workers);
+
+	auto pool = std::make_shared<BufferPool>(64 * 1024);
+	const std::weak_ptr<BufferPool> watch = pool;
+
+	CHECK(check::run(scheduler, read_all(file.path(), std::move(pool), 4)) == file.contents());
+	CHECK(watch.expired());
+}
+
+TEST(file_reader_abandoned)
+{
+	const TempFile file(4 * 1024 * 1024);
+	Scheduler scheduler(check::workers);
+	const std::size_t files = open_files();
+
+	// the pool goes away with the reader, the reads in flight hold on to it
+	auto pool = std::make_shared<BufferPool>(4096);
+	const std::weak_ptr<BufferPool> watch = pool;
+
+	CHECK(check::run(scheduler, read_first(file.path(), std::move(pool))) == 4096);
+
+	// run() delivered the reads the reader left behind, so their state, buffers and
+	// file are gone too
+	CHECK(watch.expired());
+	CHECK(open_files() == files);
+}
+
+TEST(file_reader_cancelled)
+{
+	const TempFile file(4 * 1024 * 1024);
+	Scheduler scheduler(check::workers);
+	const std::size_t files = open_files();
+
+	auto pool = std::make_shared<BufferPool>(4096);
+	const std::weak_ptr<BufferPool> watch = pool;
+
+	// every call after the cancellation throws, not only the first one
+	CancellationSource source;
+	CHECK(check::run(scheduler, with_cancellation(cancel_after_first(file.path(), std::move(pool), source), source.token())) == 2);
+
+	// the reads ahead were cancelled and delivered before run() returned
+	CHECK(watch.expired());
+	CHECK(open_files() == files);
+}
+
+TEST(file_reader_cancelled_while_reading)
+{
+	const TempFile file(1024 * 1024);
+	Scheduler scheduler(check::workers);
+	const std::size_t files = open_files();
+
+	for (int i = 0; i < 10; i++)
+	{
+		auto pool = std::make_shared<BufferPool>(4096);
+		const std::weak_ptr<BufferPool> watch = pool;
+		const auto start = Clock::now();
+		bool thrown = false;
+
+		{
+			CancellationSource source;
+			check::DelayedCancel cancel(source, 5ms);
+			thrown = check::run(scheduler, with_cancellation(read_until_cancelled(file.path(), std::move(pool)), source.token()));
+		}
+
+		CHECK(thrown);
+		CHECK(Clock::now() - start < 5s);
+		CHECK(watch.expired());
+		CHECK(open_files() == files);
+	}
+}
+#endif
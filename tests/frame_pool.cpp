@@ -0,0 +1,102 @@
+#include "check.hpp"
+
+#include <span>
+#include <unordered_set>
+
+using namespace tasky;
+
+namespace
+{
+	/// Lands in the biggest size class, 16 of them fill a slab and no task frame of the
+	/// other tests is that big.
+	constexpr std::size_t frame_size = 4000;
+
+	std::vector<void*> allocate(std::size_t count, std::size_t size = frame_size)
+	{
+		std::vector<void*> frames;
+
+		for (std::size_t i = 0; i < count; i++)
+			frames.push_back(FramePool::alloc(size));
+
+		return frames;
+	}
+
+	void release(std::span<void* const> frames)
+	{
+		for (void* frame : frames)
+			FramePool::free(frame);
+	}
+}
+
+TEST(frame_pool_remote_free_batches)
+{
+	const check::FrameCount frames;
+	const std::size_t before = FramePool::in_use();
+
+	// four whole slabs, so this thread's free list for the size class ends up empty
+	std::vector<void*> owned = allocate(64);
+	CHECK(FramePool::in_use() == before + 64);
+
+	// frames freed on another thread are counted as free right away, whether their
+	// batch went back to the owner yet or not
+	std::size_t after_partial = 0;
+	std::size_t after_full = 0;
+
+	std::thread remote([&]()
+	{
+		release(std::span(owned).first(10));
+		after_partial = FramePool::in_use();
+		release(std::span(owned).subspan(10, 30));
+		after_full = FramePool::in_use();
+	});
+	remote.join();
+
+	CHECK(after_partial == before + 54);
+	CHECK(after_full == before + 24);
+	CHECK(FramePool::in_use() == before + 24);
+
+	// the full batch and the one flushed when the thread exited are back with the owner,
+	// which picks them up once its own free list runs dry
+	const std::unordered_set<void*> freed(owned.begin(), owned.begin() + 40);
+	std::vector<void*> reused = allocate(40);
+	CHECK(std::ranges::all_of(reused, [&](void* frame) { return freed.contains(frame); }));
+
+	release(reused);
+	release(std::span(owned).subspan(40));
+	CHECK(frames.balanced());
+}
+
+TEST(frame_pool_orphaned_cache)
+{
+	const check::FrameCount frames;
+	const std::size_t before = FramePool::in_use();
+	std::vector<void*> orphaned;
+
+	// the frames outlive the thread that allocated them, one of them too big for the
+	// size classes and taken from malloc
+	std::thread owner([&]()
+	{
+		orphaned = allocate(50, 100);
+		orphaned.push_back(FramePool::alloc(10000));
+	});
+	owner.join();
+
+	CHECK(FramePool::in_use() == before + 51);
+
+	release(orphaned);
+	CHECK(frames.balanced());
+
+	// a new thread takes over a cache that lost its thread
+	std::size_t during = 0;
+
+	std::thread adopter([&]()
+	{
+		std::vector<void*> adopted = allocate(10, 100);
+		during = FramePool::in_use();
+		release(adopted);
+	});
+	adopter.join();
+
+	CHECK(during == before + 10);
+	CHECK(frames.balanced());
+}
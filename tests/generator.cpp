@@ -0,0 +1,217 @@
+#include "check.hpp"
+
+using namespace tasky;
+
+namespace
+{
+	/// Counts its copies, moves are free.
+	struct Counted
+	{
+		explicit Counted(int value, std::size_t& copies) noexcept : value(value), copies(&copies) {}
+
+		Counted(const Counted& other) : value(other.value), copies(other.copies)
+		{
+			(*copies)++;
+		}
+
+		Counted(Counted&&) noexcept = default;
+
+		int value;
+		std::size_t* copies;
+	};
+
+	/// Sets the flag when the generator frame it lives in is destroyed.
+	struct Guard
+	{
+		~Guard()
+		{
+			destroyed = true;
+		}
+
+		bool& destroyed;
+	};
+
+	Generator<Counted> by_reference(std::size_t& copies)
+	{
+		Counted counted(0, copies);
+
+		for (int i = 0; i < 3; i++)
+		{
+			counted.value = i;
+			co_yield counted;
+		}
+
+		co_yield Counted(3, copies);
+	}
+
+	Generator<Counted> by_const_reference(std::size_t& copies)
+	{
+		const Counted counted(0, copies);
+		co_yield counted;
+	}
+
+	Generator<int, FramePool> counter(bool& destroyed)
+	{
+		Guard guard{ destroyed };
+
+		for (int i = 0;; i++)
+			co_yield i;
+	}
+
+	Generator<int> failing()
+	{
+		co_yield 1;
+		throw std::runtime_error("failing");
+	}
+
+	Task<int> twice(int value)
+	{
+		co_return value * 2;
+	}
+
+	AsyncGenerator<int, FramePool> doubled(int count, bool& destroyed)
+	{
+		Guard guard{ destroyed };
+
+		for (int i = 0; i < count; i++)
+		{
+			const int value = co_await twice(i);
+			co_yield value;
+		}
+	}
+
+	Task<std::vector<int>> collect(AsyncGenerator<int, FramePool> generator, std::size_t limit)
+	{
+		std::vector<int> values;
+
+		while (values.size() < limit)
+		{
+			const int* value = co_await generator.next();
+
+			if (value == nullptr)
+				break;
+
+			values.push_back(*value);
+		}
+
+		co_return values;
+	}
+
+	AsyncGenerator<int> failing_async()
+	{
+		co_yield 1;
+		co_await twice(1);
+		throw std::runtime_error("failing");
+	}
+
+	Task<bool> rethrown()
+	{
+		auto generator = failing_async();
+		const int* first = co_await generator.next();
+
+		try
+		{
+			co_await generator.next();
+		}
+		catch (const std::runtime_error&)
+		{
+			co_return first != nullptr && *first == 1;
+		}
+
+		co_return false;
+	}
+}
+
+TEST(generator_yields_without_copies)
+{
+	std::size_t copies = 0;
+	std::vector<int> values;
+
+	for (const Counted& counted : by_reference(copies))
+		values.push_back(counted.value);
+
+	CHECK((values == std::vector{ 0, 1, 2, 3 }));
+	CHECK(copies == 0);
+
+	// a const lvalue cannot be handed out as mutable, so that one is copied
+	for (const Counted& counted : by_const_reference(copies))
+		CHECK(counted.value == 0);
+
+	CHECK(copies == 1);
+}
+
+TEST(generator_destroyed_early)
+{
+	const check::FrameCount frames;
+	bool destroyed = false;
+	int sum = 0;
+
+	{
+		auto generator = counter(destroyed);
+
+		for (int value : generator)
+		{
+			if (value == 5)
+				break;
+
+			sum += value;
+		}
+
+		CHECK(!destroyed);
+	}
+
+	// the suspended body was unwound along with its frame
+	CHECK(sum == 10);
+	CHECK(destroyed);
+	CHECK(frames.balanced());
+}
+
+TEST(generator_rethrows)
+{
+	std::vector<int> values;
+	bool thrown = false;
+
+	try
+	{
+		for (int value : failing())
+			values.push_back(value);
+	}
+	catch (const std::runtime_error&)
+	{
+		thrown = true;
+	}
+
+	CHECK(thrown);
+	CHECK((values == std::vector{ 1 }));
+}
+
+TEST(async_generator_awaits)
+{
+	Scheduler scheduler(check::workers);
+	const check::FrameCount frames;
+	bool destroyed = false;
+
+	const std::vector<int> values = check::run(scheduler, collect(doubled(4, destroyed), 100));
+	CHECK((values == std::vector{ 0, 2, 4, 6 }));
+	CHECK(destroyed);
+	CHECK(frames.balanced());
+}
+
+TEST(async_generator_destroyed_early)
+{
+	Scheduler scheduler(check::workers);
+	const check::FrameCount frames;
+	bool destroyed = false;
+
+	const std::vector<int> values = check::run(scheduler, collect(doubled(1000, destroyed), 3));
+	CHECK((values == std::vector{ 0, 2, 4 }));
+	CHECK(destroyed);
+	CHECK(frames.balanced());
+}
+
+TEST(async_generator_rethrows)
+{
+	Scheduler scheduler(check::workers);
+
+	CHECK(check::run(scheduler, rethrown()));
+}
@@ -0,0 +1,29 @@
+#include "check.hpp"
+
+#include <cstring>
+
+/// Runs every test, or the ones whose name contains the first argument.
+int main(int argc, char* argv[])
+{
+	const char* filter = argc > 1 ? argv[1] : "";
+	std::size_t failed = 0;
+
+	for (const check::Case& test : check::cases())
+	{
+		if (std::strstr(test.name, filter) == nullptr)
+			continue;
+
+		try
+		{
+			test.run();
+			std::cout << test.name << ": ok" << std::endl;
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << test.name << ": FAILED\n    " << e.what() << std::endl;
+			failed++;
+		}
+	}
+
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
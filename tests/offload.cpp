@@ -0,0 +1,194 @@
+#include "check.hpp"
+
+#include "blocking/pool.hpp"
+
+#include <latch>
+
+using namespace tasky;
+using namespace std::chrono_literals;
+using check::Clock;
+
+namespace
+{
+	Task<int> offloaded(std::thread::id& caller, std::thread::id& callee)
+	{
+		caller = std::this_thread::get_id();
+		const int value = co_await offload([&]() {
+			callee = std::this_thread::get_id();
+			return 42;
+		});
+
+		// back on a worker of ours
+		CHECK(Scheduler::current() != nullptr);
+		co_return value;
+	}
+
+	Task<bool> rethrown()
+	{
+		try
+		{
+			co_await offload([]() { throw std::out_of_range("offloaded"); });
+		}
+		catch (const std::out_of_range& e)
+		{
+			co_return std::string_view(e.what()) == "offloaded";
+		}
+
+		co_return false;
+	}
+
+	/// Blocks its pool thread until the latch opens.
+	struct Blocker : blocking::Job
+	{
+		explicit Blocker(std::latch& release, std::atomic<std::size_t>& done) : release(release), done(done)
+		{
+			run = [](blocking::Job& job) {
+				Blocker& self = static_cast<Blocker&>(job);
+				self.release.wait();
+				self.done++;
+			};
+		}
+
+		std::latch& release;
+		std::atomic<std::size_t>& done;
+	};
+
+	/// Waits up to `timeout` for `condition()`, polling.
+	template<typename Condition>
+	[[nodiscard]] bool eventually(Condition condition, std::chrono::milliseconds timeout = 10s)
+	{
+		const auto deadline = Clock::now() + timeout;
+
+		while (!condition())
+		{
+			if (Clock::now() > deadline)
+				return false;
+
+			std::this_thread::sleep_for(1ms);
+		}
+
+		return true;
+	}
+
+	/// Lowers the limit and leaves a task in the next slot of the worker it runs on,
+	/// whoever runs it has to steal it from the deque the rested worker moved it to.
+	Task<void> spawn_and_rest(Scheduler& scheduler, Task<void> child)
+	{
+		scheduler.set_active_workers(1);
+		scheduler.schedule(child);
+		co_return;
+	}
+
+	Task<void> count(std::atomic<std::size_t>& done)
+	{
+		done++;
+		co_return;
+	}
+
+	/// Keeps its worker busy until `arrived` reaches `expected`, so they only all finish
+	/// when that many workers run at once.
+	Task<void> meet(std::atomic<std::size_t>& arrived, std::size_t expected, std::atomic<bool>& met)
+	{
+		arrived++;
+		const auto deadline = Clock::now() + 10s;
+
+		while (arrived.load() < expected)
+		{
+			if (Clock::now() > deadline)
+				co_return;
+		}
+
+		met = true;
+	}
+
+	Task<void> lower_then_raise(Scheduler& scheduler, std::size_t& done_rested, std::atomic<bool>& met)
+	{
+		constexpr std::size_t spawners = 16;
+
+		std::atomic<std::size_t> done = 0;
+		std::vector<Task<void>> tasks;
+		for (std::size_t i = 0; i < spawners; i++)
+			tasks.push_back(spawn_and_rest(scheduler, count(done)));
+
+		co_await all(std::move(tasks));
+		CHECK(scheduler.active_workers() == 1);
+
+		const auto deadline = Clock::now() + 10s;
+
+		while (done.load() < spawners && Clock::now() < deadline)
+			co_await sleep_for(1ms);
+
+		// a child stuck in a rested worker would only run once the limit goes back up
+		done_rested = done.load();
+
+		// every worker is needed again, the rested ones included
+		const std::size_t workers = scheduler.worker_count();
+		scheduler.set_active_workers(workers);
+		CHECK(scheduler.active_workers() == workers);
+
+		std::atomic<std::size_t> arrived = 0;
+		std::vector<Task<void>> meetings;
+		for (std::size_t i = 0; i < workers; i++)
+			meetings.push_back(meet(arrived, workers, met));
+
+		co_await all(std::move(meetings));
+	}
+}
+
+TEST(offload_returns_value)
+{
+	Scheduler scheduler(check::workers);
+	std::thread::id caller;
+	std::thread::id callee;
+
+	CHECK(check::run(scheduler, offloaded(caller, callee)) == 42);
+	CHECK(callee != std::thread::id());
+	CHECK(callee != caller);
+	CHECK(callee != std::this_thread::get_id());
+}
+
+TEST(offload_rethrows)
+{
+	Scheduler scheduler(check::workers);
+
+	CHECK(check::run(scheduler, rethrown()));
+}
+
+TEST(blocking_pool_grows_and_retires)
+{
+	std::atomic<std::size_t> done = 0;
+	std::latch release(1);
+	blocking::Pool pool(2, 20ms);
+
+	std::vector<std::unique_ptr<Blocker>> jobs;
+	for (std::size_t i = 0; i < 3; i++)
+	{
+		jobs.push_back(std::make_unique<Blocker>(release, done));
+		pool.submit(*jobs.back());
+	}
+
+	// one thread per job up to the limit, the third one waits for a thread
+	const bool queued = eventually([&]() { return pool.queue_size() == 1; });
+	const std::size_t threads = pool.thread_count();
+
+	release.count_down();
+	CHECK(queued);
+	CHECK(threads == 2);
+	CHECK(eventually([&]() { return done.load() == 3; }));
+
+	// idle for longer than keep_alive, the threads exit
+	CHECK(eventually([&]() { return pool.thread_count() == 0; }));
+	CHECK(pool.queue_size() == 0);
+}
+
+TEST(active_workers_lowered_and_raised)
+{
+	Scheduler scheduler(check::workers);
+	std::size_t done_rested = 0;
+	std::atomic<bool> met = false;
+
+	check::run(scheduler, lower_then_raise(scheduler, done_rested, met));
+
+	CHECK(done_rested == 16);
+	CHECK(met);
+}
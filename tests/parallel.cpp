@@ -0,0 +1,137 @@
+#include "check.hpp"
+
+#include <numeric>
+#include <ranges>
+#include <set>
+
+using namespace tasky;
+
+namespace
+{
+	constexpr std::size_t count = 100000;
+
+	Task<void> visit(std::vector<std::atomic<std::size_t>>& visits, std::size_t grain)
+	{
+		co_await parallel_for(std::views::iota(std::size_t(0), visits.size()), [&](std::size_t i) {
+			visits[i]++;
+		}, grain);
+	}
+
+	/// Throws from every element past the first few blocks.
+	Task<void> failing(std::atomic<std::size_t>& thrown)
+	{
+		co_await parallel_for(std::views::iota(std::size_t(0), count), [&](std::size_t i) {
+			if (i >= 1000)
+			{
+				thrown++;
+				throw std::out_of_range(std::to_string(i));
+			}
+		}, 10);
+	}
+
+	/// Notes which threads ran a block, each block takes a while.
+	Task<void> spread(std::set<std::thread::id>& threads, std::mutex& mutex)
+	{
+		co_await parallel_for(std::views::iota(0, 64), [&](int) {
+			{
+				std::scoped_lock lock(mutex);
+				threads.insert(std::this_thread::get_id());
+			}
+
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}, 1);
+	}
+}
+
+TEST(parallel_for_visits_once)
+{
+	Scheduler scheduler(check::workers);
+
+	// one element per block forks as much as it can, the default grain hardly at all
+	for (const std::size_t grain : { std::size_t(1), std::size_t(0), count })
+	{
+		std::vector<std::atomic<std::size_t>> visits(count);
+		check::run(scheduler, visit(visits, grain));
+
+		CHECK(std::ranges::all_of(visits, [](const auto& visited) { return visited == 1; }));
+	}
+}
+
+TEST(parallel_transform_in_place)
+{
+	Scheduler scheduler(check::workers);
+	std::vector<std::size_t> input(count);
+	std::iota(input.begin(), input.end(), std::size_t(0));
+	std::vector<std::size_t> output(count);
+
+	check::run(scheduler, parallel_transform(input, output.begin(), [](std::size_t i) { return i * 3; }, 7));
+
+	CHECK(std::ranges::equal(output, input | std::views::transform([](std::size_t i) { return i * 3; })));
+}
+
+TEST(parallel_reduce_in_order)
+{
+	Scheduler scheduler(check::workers);
+
+	// concatenation is associative but not commutative, any reordering shows
+	std::vector<std::string> digits;
+	std::string expected = ">";
+
+	for (std::size_t i = 0; i < 5000; i++)
+	{
+		digits.push_back(std::to_string(i % 10));
+		expected += digits.back();
+	}
+
+	const std::string joined = check::run(scheduler, parallel_reduce(digits, std::string(">"), std::plus(), 3));
+	CHECK(joined == expected);
+}
+
+TEST(parallel_empty_and_single)
+{
+	Scheduler scheduler(check::workers);
+	const std::vector<int> empty;
+	const std::vector<int> single = { 42 };
+	std::size_t calls = 0;
+
+	check::run(scheduler, parallel_for(empty, [&](int) { calls++; }));
+	CHECK(calls == 0);
+
+	check::run(scheduler, parallel_for(single, [&](int value) { calls += value; }));
+	CHECK(calls == 42);
+
+	CHECK(check::run(scheduler, parallel_reduce(empty, 7, std::plus())) == 7);
+	CHECK(check::run(scheduler, parallel_reduce(single, 7, std::minus())) == 7 - 42);
+}
+
+TEST(parallel_for_rethrows_first)
+{
+	Scheduler scheduler(check::workers);
+	std::atomic<std::size_t> thrown = 0;
+	bool caught = false;
+
+	try
+	{
+		check::run(scheduler, failing(thrown));
+	}
+	catch (const std::out_of_range& e)
+	{
+		caught = std::stoul(e.what()) >= 1000;
+	}
+
+	// one exception comes out, once one was thrown the blocks not started yet are skipped
+	CHECK(caught);
+	CHECK(thrown >= 1);
+	CHECK(thrown < count - 1000);
+}
+
+TEST(parallel_for_wakes_parked_workers)
+{
+	Scheduler scheduler(check::workers);
+	std::set<std::thread::id> threads;
+	std::mutex mutex;
+
+	// the workers are parked when the loop starts, every one of them gets a share
+	check::run(scheduler, spread(threads, mutex));
+	CHECK(threads.size() == check::workers + 1);
+}
@@ -0,0 +1,145 @@
+#include "check.hpp"
+
+#include "lockfree/segmented_queue.hpp"
+
+using namespace tasky;
+using namespace std::chrono_literals;
+
+namespace
+{
+	constexpr std::size_t producers = 3;
+	constexpr std::size_t consumers = 2;
+	constexpr std::size_t per_producer = 20000;
+	constexpr std::size_t total = producers * per_producer;
+
+	/// Runs `produce(p)` for every producer and `consume()` on the consumers until
+	/// `total` elements were taken, or gives up after a while so a lost element fails
+	/// the test instead of hanging it. `consume` returns how many it took.
+	template<typename Produce, typename Consume>
+	[[nodiscard]] bool run_threads(Produce produce, Consume consume)
+	{
+		std::atomic<std::size_t> taken = 0;
+		const auto deadline = std::chrono::steady_clock::now() + 30s;
+		std::vector<std::thread> threads;
+
+		for (std::size_t p = 0; p < producers; p++)
+			threads.emplace_back([&produce, p]() { produce(p); });
+
+		for (std::size_t c = 0; c < consumers; c++)
+		{
+			threads.emplace_back([&]()
+			{
+				while (taken.load() < total && std::chrono::steady_clock::now() < deadline)
+				{
+					const std::size_t n = consume();
+
+					if (n == 0)
+						std::this_thread::yield();
+
+					taken += n;
+				}
+			});
+		}
+
+		for (auto& thread : threads)
+			thread.join();
+
+		return taken == total;
+	}
+
+	Task<void> mark(std::vector<std::atomic<std::size_t>>& runs, std::size_t index)
+	{
+		runs[index]++;
+		co_return;
+	}
+}
+
+TEST(queue_close)
+{
+	lockfree::Queue<int> queue(4);
+
+	CHECK(queue.try_push(1));
+	CHECK(queue.try_push(2));
+	CHECK(!queue.closed());
+
+	queue.close();
+	CHECK(queue.closed());
+	CHECK(!queue.try_push(3));
+
+	// closing only stops the pushes
+	int value = 0;
+	CHECK(queue.try_pop(value) && value == 1);
+	CHECK(queue.try_pop(value) && value == 2);
+	CHECK(!queue.try_pop(value));
+	CHECK(!queue.try_push(4));
+}
+
+TEST(segmented_queue_grows_in_order)
+{
+	lockfree::SegmentedQueue<int> queue(4);
+
+	for (int i = 0; i < 100; i++)
+		queue.push(i);
+
+	CHECK(queue.capacity() == 64);
+	CHECK(queue.size() == 100);
+
+	// with a single producer the order survives the segment boundaries
+	int value = -1;
+
+	for (int i = 0; i < 100; i++)
+		CHECK(queue.try_pop(value) && value == i);
+
+	CHECK(!queue.try_pop(value));
+	CHECK(queue.empty());
+}
+
+TEST(segmented_queue_exactly_once)
+{
+	lockfree::SegmentedQueue<std::size_t> queue(4);
+	std::vector<std::atomic<std::size_t>> seen(total);
+
+	// an element pushed into a segment the consumers had already left would never come
+	// out, run_threads() would give up waiting for it
+	const bool done = run_threads(
+		[&](std::size_t p) {
+			for (std::size_t i = 0; i < per_producer; i++)
+				queue.push(p * per_producer + i);
+		},
+		[&]() -> std::size_t {
+			std::size_t value = 0;
+
+			if (!queue.try_pop(value))
+				return 0;
+
+			seen[value]++;
+			return 1;
+		});
+
+	CHECK(done);
+	CHECK(std::ranges::all_of(seen, [](const auto& count) { return count == 1; }));
+	CHECK(queue.capacity() > 4);
+	CHECK(queue.empty());
+}
+
+TEST(scheduler_queue_grows)
+{
+	constexpr std::size_t count = 2000;
+
+	Scheduler scheduler(check::workers, 4);
+	const std::size_t capacity = scheduler.queue_capacity();
+	std::vector<std::atomic<std::size_t>> runs(count);
+
+	// from outside the pool everything goes through the shared queue
+	std::vector<Task<void>> tasks;
+	for (std::size_t i = 0; i < count; i++)
+		tasks.push_back(mark(runs, i));
+
+	for (const auto& task : tasks)
+		scheduler.schedule(task);
+
+	CHECK(scheduler.queue_capacity() > capacity);
+	scheduler.run();
+
+	CHECK(std::ranges::all_of(runs, [](const auto& count) { return count == 1; }));
+}
@@ -0,0 +1,163 @@
+#include "check.hpp"
+
+using namespace tasky;
+using namespace std::chrono_literals;
+
+namespace
+{
+	/// Raises `peak` to `value` unless it is higher already.
+	void raise(std::atomic<std::size_t>& peak, std::size_t value)
+	{
+		std::size_t seen = peak.load();
+
+		while (value > seen && !peak.compare_exchange_weak(seen, value));
+	}
+
+	Task<void> increment(AsyncMutex& mutex, std::size_t& counter, std::size_t iterations)
+	{
+		for (std::size_t i = 0; i < iterations; i++)
+		{
+			if (i % 2 == 0)
+			{
+				co_await mutex.lock();
+				counter++;
+				mutex.unlock();
+				continue;
+			}
+
+			auto lock = co_await mutex.scoped_lock();
+			const std::size_t seen = counter;
+
+			// suspending with the mutex held lines the other tasks up behind it
+			if (i % 100 == 1)
+				co_await sleep_for(50us);
+
+			counter = seen + 1;
+		}
+	}
+
+	Task<void> limited(AsyncSemaphore& semaphore, std::atomic<std::size_t>& inside, std::atomic<std::size_t>& peak)
+	{
+		auto permit = co_await semaphore.scoped_acquire();
+		raise(peak, ++inside);
+		co_await sleep_for(1ms);
+		inside--;
+	}
+
+	Task<void> wait_for(AsyncEvent& event, std::atomic<std::size_t>& woken)
+	{
+		co_await event.wait();
+		woken++;
+	}
+
+	Task<void> arrive(Latch& latch, std::atomic<std::size_t>& arrived, bool wait)
+	{
+		arrived++;
+
+		if (wait)
+			co_await latch.arrive_and_wait();
+		else
+			latch.count_down();
+	}
+
+	Task<void> await_latch(Latch& latch, std::atomic<std::size_t>& arrived, std::size_t expected)
+	{
+		co_await latch.wait();
+		CHECK(arrived == expected);
+	}
+}
+
+TEST(mutex_counter)
+{
+	constexpr std::size_t tasks = 64;
+	constexpr std::size_t iterations = 1000;
+
+	Scheduler scheduler(check::workers);
+	AsyncMutex mutex;
+	std::size_t counter = 0;
+
+	std::vector<Task<void>> incrementers;
+	for (std::size_t i = 0; i < tasks; i++)
+		incrementers.push_back(increment(mutex, counter, iterations));
+
+	check::run(scheduler, check::join(std::move(incrementers)));
+
+	CHECK(counter == tasks * iterations);
+	CHECK(mutex.try_lock());
+	mutex.unlock();
+}
+
+TEST(semaphore_caps_concurrency)
+{
+	constexpr std::size_t permits = 4;
+
+	Scheduler scheduler(check::workers);
+	AsyncSemaphore semaphore(permits);
+	std::atomic<std::size_t> inside = 0;
+	std::atomic<std::size_t> peak = 0;
+
+	std::vector<Task<void>> tasks;
+	for (std::size_t i = 0; i < 100; i++)
+		tasks.push_back(limited(semaphore, inside, peak));
+
+	check::run(scheduler, check::join(std::move(tasks)));
+
+	// every task sleeps holding its permit, so the permits do get used up
+	CHECK(peak == permits);
+	CHECK(inside == 0);
+	CHECK(semaphore.available() == static_cast<std::ptrdiff_t>(permits));
+}
+
+TEST(event_set_from_another_thread)
+{
+	constexpr std::size_t waiters = 100;
+
+	Scheduler scheduler(check::workers);
+	AsyncEvent event;
+	std::atomic<std::size_t> woken = 0;
+
+	std::vector<Task<void>> tasks;
+	for (std::size_t i = 0; i < waiters; i++)
+		tasks.push_back(wait_for(event, woken));
+
+	std::thread setter([&]()
+	{
+		std::this_thread::sleep_for(20ms);
+		event.set();
+	});
+
+	check::run(scheduler, check::join(std::move(tasks)));
+	setter.join();
+
+	CHECK(woken == waiters);
+	CHECK(event.is_set());
+
+	event.reset();
+	CHECK(!event.is_set());
+}
+
+TEST(latch_release)
+{
+	constexpr std::size_t count = 50;
+
+	Scheduler scheduler(check::workers);
+	Latch latch(count);
+	std::atomic<std::size_t> arrived = 0;
+
+	// queued ahead of the arrivals, so some of them get to suspend on the latch
+	std::vector<Task<void>> tasks;
+	for (std::size_t i = 0; i < 10; i++)
+		tasks.push_back(await_latch(latch, arrived, count));
+
+	for (std::size_t i = 0; i < count; i++)
+		tasks.push_back(arrive(latch, arrived, i % 2 == 0));
+
+	check::run(scheduler, check::join(std::move(tasks)));
+
+	CHECK(arrived == count);
+	CHECK(latch.try_wait());
+
+	Latch open(0);
+	CHECK(open.try_wait());
+	check::run(scheduler, [](Latch& latch) -> Task<void> { co_await latch.wait(); }(open));
+}
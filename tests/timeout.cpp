@@ -0,0 +1,94 @@
+#include "check.hpp"
+
+using namespace tasky;
+using namespace std::chrono_literals;
+using check::Clock;
+
+namespace
+{
+	Task<void, FramePool> pause(std::chrono::milliseconds delay)
+	{
+		co_await sleep_for(delay);
+	}
+
+	Task<void> wake_after(std::chrono::milliseconds delay, std::atomic<std::size_t>& early)
+	{
+		const auto deadline = Clock::now() + delay;
+		co_await sleep_for(delay);
+
+		if (Clock::now() < deadline)
+			early++;
+	}
+
+	Task<void> give_up(std::chrono::milliseconds timeout, std::atomic<std::size_t>& late)
+	{
+		const bool done = co_await with_timeout(pause(10s), timeout);
+
+		if (done)
+			late++;
+	}
+}
+
+TEST(sleep_for_waits)
+{
+	Scheduler scheduler(check::workers);
+	const auto start = Clock::now();
+
+	CHECK(check::run(scheduler, check::after(20ms, 1)) == 1);
+	CHECK(Clock::now() - start >= 20ms);
+}
+
+TEST(with_timeout_in_time)
+{
+	Scheduler scheduler(check::workers);
+	const check::FrameCount frames;
+
+	const std::optional<int> value = check::run(scheduler, with_timeout(check::after(1ms, 7), 10s));
+	CHECK(value == 7);
+
+	const bool done = check::run(scheduler, with_timeout(pause(1ms), 10s));
+	CHECK(done);
+
+	CHECK(frames.balanced());
+}
+
+TEST(with_timeout_too_late)
+{
+	Scheduler scheduler(check::workers);
+	const check::FrameCount frames;
+	const auto start = Clock::now();
+
+	const std::optional<int> value = check::run(scheduler, with_timeout(check::after(10s, 7), 10ms));
+	CHECK(!value);
+
+	const bool done = check::run(scheduler, with_timeout(pause(10s), 10ms));
+	CHECK(!done);
+
+	// the late tasks were cancelled, not waited for, and freed their frames
+	CHECK(Clock::now() - start < 5s);
+	CHECK(frames.balanced());
+}
+
+TEST(timers_on_every_worker)
+{
+	Scheduler scheduler(check::workers);
+	const auto start = Clock::now();
+	std::atomic<std::size_t> early = 0;
+	std::atomic<std::size_t> late = 0;
+
+	// the workers arm and cancel timers in their own wheels and expire each other's
+	std::vector<Task<void>> tasks;
+
+	for (std::size_t i = 0; i < 256; i++)
+		tasks.push_back(wake_after(std::chrono::milliseconds(i % 32), early));
+
+	for (std::size_t i = 0; i < 64; i++)
+		tasks.push_back(give_up(std::chrono::milliseconds(i % 16), late));
+
+	check::run(scheduler, check::join(std::move(tasks)));
+
+	CHECK(early == 0);
+	CHECK(late == 0);
+	CHECK(Clock::now() - start < 5s);
+	CHECK(scheduler.stats().timers == 0);
+}
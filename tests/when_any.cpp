@@ -0,0 +1,63 @@
+#include "check.hpp"
+
+using namespace tasky;
+using namespace std::chrono_literals;
+using check::Clock;
+
+namespace
+{
+	Task<int, FramePool> failing()
+	{
+		co_await sleep_for(1ms);
+		throw std::runtime_error("failing");
+	}
+
+	Task<AnyResult<int>> race(std::vector<Task<int, FramePool>> tasks)
+	{
+		co_return co_await when_any(std::move(tasks));
+	}
+
+	Task<bool> rethrown(Task<int, FramePool> fast, Task<int, FramePool> slow)
+	{
+		try
+		{
+			co_await when_any(std::move(fast), std::move(slow));
+		}
+		catch (const std::runtime_error&)
+		{
+			co_return true;
+		}
+
+		co_return false;
+	}
+}
+
+TEST(when_any_frees_losers)
+{
+	Scheduler scheduler(check::workers);
+	const check::FrameCount frames;
+	const auto start = Clock::now();
+
+	std::vector<Task<int, FramePool>> tasks;
+	tasks.push_back(check::after(10s, 1));
+	tasks.push_back(check::after(1ms, 2));
+	tasks.push_back(check::after(10s, 3));
+
+	const AnyResult<int> result = check::run(scheduler, race(std::move(tasks)));
+
+	// the sleepers were cancelled rather than waited for, and run() waits for them to
+	// finish since they are root tasks
+	CHECK(result.index == 1);
+	CHECK(result.value == 2);
+	CHECK(Clock::now() - start < 5s);
+	CHECK(frames.balanced());
+}
+
+TEST(when_any_rethrows_first)
+{
+	Scheduler scheduler(check::workers);
+	const check::FrameCount frames;
+
+	CHECK(check::run(scheduler, rethrown(failing(), check::after(10s, 1))));
+	CHECK(frames.balanced());
+}